@@ -30,39 +30,55 @@ SOFTWARE.
 #include <string>
 #include <sstream>
 #include <cstdlib>
+#include <atomic>
 #include "jackClient.hpp"
 #include "JackBridge.h"
+#include "arena.hpp"
 #ifdef _WITH_MIDI_BRIDGE_
-#include <rtmidi/RtMidi.h>
-#define MAX_MIDI_PORTS 256
+#include "midiBridge.hpp"
+#include "midiClock.hpp"
 #endif // _WITH_MIDI_BRIDGE_
 
 /*
  * JackBridge.cpp
  */
-#define NUM_INPUT_CHANNELS  (NUM_INPUT_STREAMS*2)
-#define NUM_OUTPUT_CHANNELS (NUM_OUTPUT_STREAMS*2)
-
-class JackBridge : public JackClient, public JackBridgeDriverIF {
+class JackBridge : public JackClientT<JackBridge>, public JackBridgeDriverIF {
 public:
-    JackBridge(const char* name, int id, int num_Min, int num_Mout) : JackClient(name, JACK_PROCESS_CALLBACK), JackBridgeDriverIF(id) {
+    // channels: Jack ports per stream, the rings carry as many as the driver asks for
+    JackBridge(const char* name, int id, int num_Min, int num_Mout, int channels = JB_DEFAULT_CHANNELS) : JackClientT<JackBridge>(name), JackBridgeDriverIF(id) {
         if (attach_shm() < 0) {
             fprintf(stderr, "Attaching shared memory failed (id=%d)\n", id);
             exit(1);
         }
 
         isActive = false;
+        isFreewheel = false;
+        freewheelRequest = false;
         isSyncMode = true; // FIXME: should be parameterized
         isVerbose = (getenv("JACKBRIDGE_DEBUG")) ? true : false;
         FrameNumber = 0;
-        FramesPerBuffer = STRBUFNUM/2;
+        numChannels = channels;
+        ringChannels = JB_DEFAULT_CHANNELS;
+        ringSampleRate = JB_DEFAULT_SAMPLE_RATE;
+        FramesPerBuffer = JB_RING_FRAMES(ringChannels, ringSampleRate);
+        StampPeriod = FramesPerBuffer;
         *shmBufferSize = STRBUFSZ;
         *shmSyncMode = 0;
+        *shmTimebase = JB_TIMEBASE_HOST;
+
+        // the driver derives its time stamp period from it
+        *shmJackPeriod = BufSize;
+        // and follows Jack's sample rate
+        *shmJackSampleRate = SampleRate;
+        rateMismatch = false;
 
         config_audio_ports();
 #ifdef _WITH_MIDI_BRIDGE_
-        create_midi_ports(name, num_Min, num_Mout);
-        register_ports((const char**)nameAin, (const char**)nameAout, (const char**)nameMin, (const char**)nameMout);
+        midi.create_ports(name,
+            (num_Min < 0) ? get_num_ports(JackPortIsInput) : num_Min,
+            (num_Mout < 0) ? get_num_ports(JackPortIsOutput) : num_Mout);
+        register_ports((const char**)nameAin, (const char**)nameAout, (const char**)midi.nameMin, (const char**)midi.nameMout);
+        midiClock.set_sample_rate(SampleRate);
 #else
         register_ports((const char**)nameAin, (const char**)nameAout, NULL, NULL);
 #endif // _WITH_MIDI_BRIDGE_
@@ -71,7 +87,7 @@ public:
         lastHostTime = 0;
         struct mach_timebase_info theTimeBaseInfo;
         mach_timebase_info(&theTimeBaseInfo);
-        double theHostClockFrequency = theTimeBaseInfo.denom / theTimeBaseInfo.numer;
+        double theHostClockFrequency = (double)theTimeBaseInfo.denom / theTimeBaseInfo.numer;
         theHostClockFrequency *= 1000000000.0;
         HostTicksPerFrame = theHostClockFrequency / SampleRate;
         if (isVerbose) {
@@ -82,29 +98,53 @@ public:
 
     ~JackBridge() {
 #ifdef _WITH_MIDI_BRIDGE_
-        release_midi_ports();
+        midi.release_ports();
 #endif // _WITH_MIDI_BRIDGE_
     }
 
-    int process_callback(jack_nframes_t nframes) override {
-        sample_t *ain[NUM_INPUT_CHANNELS];
-        sample_t *aout[NUM_OUTPUT_CHANNELS];
-
+    int process_callback(jack_nframes_t nframes) {
 #ifdef _WITH_MIDI_BRIDGE_
-        process_midi_message(nframes);
+        int nevents;
+        const midiEvent_t* events = get_midi_events(nframes, &nevents);
+        midi.process(events, nevents, midiOutBuf);
+        if (midiClock.is_enabled()) {
+            jack_position_t pos;
+            jack_transport_state_t state = transport_query(&pos);
+            midiClock.process(state, &pos, nframes);
+            for(int n=0; n<midi.nInPorts; n++) {
+                midiClock.write(midiOutBuf[n]);
+            }
+        }
 #endif // _WITH_MIDI_BRIDGE_
 
         if (*shmDriverStatus != JB_DRV_STATUS_STARTED) {
             // Driver isn't working. Just return zero buffer;
-            for(int i=0; i<NUM_OUTPUT_CHANNELS; i++) {
-                aout[i] = (sample_t*)jack_port_get_buffer(audioOut[i], nframes);
-                bzero(aout[i], STRBUFSZ);
+            for(int i=0; i<NUM_OUTPUT_STREAMS*numChannels; i++) {
+                bzero(audioOutBuf[i], sizeof(sample_t)*nframes);
             }
             return 0;
         }
 
+        update_timebase();
+
+        // the driver may change the ring layout and the time stamp period while IO is stopped
+        uint32_t nch = shm_channels();
+        uint32_t rate = shm_sample_rate();
+        if ((nch != ringChannels) || (rate != ringSampleRate)) {
+            ringChannels = nch;
+            ringSampleRate = rate;
+            FramesPerBuffer = shm_ring_frames();
+            rateMismatch = (ringSampleRate != (uint32_t)SampleRate);
+        }
+        StampPeriod = shm_stamp_period(FramesPerBuffer);
+        if (*shmJackPeriod != nframes) {
+            *shmJackPeriod = nframes;
+        }
+
         // For DEBUG
-        check_progress();
+        if (!isFreewheel) {
+            check_progress();
+        }
 
         if (!isActive) {
             ncalls = 0;
@@ -121,11 +161,11 @@ public:
                 instance, isSyncMode ? "Yes" : "No", *shmZeroHostTime);
         }
 
-        if ((FrameNumber % FramesPerBuffer) == 0) {
+        if ((FrameNumber % StampPeriod) == 0) {
             // FIXME: Should be atomic operation and do memory barrier
             if(*shmSyncMode == 1) {
-                *shmZeroHostTime = mach_absolute_time();
-                *shmNumberTimeStamps = FrameNumber / FramesPerBuffer;
+                *shmZeroHostTime = zero_host_time();
+                *shmNumberTimeStamps = FrameNumber / StampPeriod;
                 //(*shmNumberTimeStamps)++;
             } 
 
@@ -136,43 +176,88 @@ public:
             }
         }
 
-        for(int i=0; i<NUM_INPUT_CHANNELS; i++) {
-            ain[i] = (sample_t*)jack_port_get_buffer(audioIn[i], nframes);
-        }
-        sendToCoreAudio(ain, nframes);
-
-
-        for(int i=0; i<NUM_OUTPUT_CHANNELS; i++) {
-            aout[i] = (sample_t*)jack_port_get_buffer(audioOut[i], nframes);
+        if (rateMismatch) {
+            // until the driver follows Jack's rate, audio would play at the wrong pitch
+            muteCoreAudio(audioOutBuf, nframes);
+        } else {
+            sendToCoreAudio(audioInBuf, nframes);
+            receiveFromCoreAudio(audioOutBuf, nframes);
         }
-        receiveFromCoreAudio(aout, nframes);
 
         FrameNumber += nframes;
 
+        // the driver measures its latency and safety offset against it
+        *shmDaemonFrame = FrameNumber;
+
         return 0;
     }
 
+    // Called by Jack (not in the process thread) when an offline export
+    // starts or ends. Picked up by the next process cycle.
+    void freewheel_callback(int starting) {
+        freewheelRequest.store(starting != 0, std::memory_order_release);
+    }
+
     void setVerbose(bool flag) {
         printf("JackBridge#%d: Verbose mode %s.\n", instance, flag ? "on" : "off");
         isVerbose = flag;
     }
 
+#ifdef _WITH_MIDI_BRIDGE_
+    // MIDI Clock / MTC are merged into every "event_out_*" port.
+    // fps == 0 disables MTC, bpm is used while transport has no BBT info.
+    void setMidiClock(bool clock, int fps, double bpm) {
+        midiClock.enable_clock(clock);
+        midiClock.enable_mtc(fps);
+        midiClock.set_default_tempo(bpm);
+    }
+
+    // filters are added before openMidiPorts()
+    bool addMidiFilter(const char* spec) {
+        return midi.add_filter(spec);
+    }
+
+    void openMidiPorts() {
+        midi.open_ports();
+    }
+#endif // _WITH_MIDI_BRIDGE_
+
 private:
     bool isActive, isSyncMode, isVerbose;
+    bool isFreewheel;
+    std::atomic<bool> freewheelRequest;
+    uint64_t virtualAnchorHostTime;
+    uint64_t virtualAnchorFrame;
     bool showmsg;
     uint64_t lastHostTime;
     double HostTicksPerFrame;
     int64_t ncalls;
+    int numChannels;        // Jack ports per stream
+    uint32_t ringChannels;  // channels per frame in the rings
+    uint32_t ringSampleRate; // sample rate the ring size follows
+    bool rateMismatch;      // ringSampleRate isn't Jack's, see muteCoreAudio()
+    uint32_t StampPeriod;   // frames between zero time stamps
     char** nameAin;
     char** nameAout;
 
+    // Channels the rings have and Jack hasn't are zero filled, channels
+    // Jack has and the rings haven't are dropped (or silent).
     int sendToCoreAudio(float** in,int nframes) {
         unsigned int offset = FrameNumber % FramesPerBuffer;
+        int nch = (int)ringChannels;
+        int ncopy = (numChannels < nch) ? numChannels : nch;
         // FIXME: should be consider buffer overwrapping
-        for(int i=0; i<nframes; i++) {
-            for(int j=0; j<NUM_INPUT_STREAMS; j++) {
-                *(buf_down[j]+(offset+i)*2) = in[j*2][i];
-                *(buf_down[j]+(offset+i)*2+1) = in[j*2+1][i];
+        for(int j=0; j<NUM_INPUT_STREAMS; j++) {
+            sample_t* ring = buf_down[j] + offset*nch;
+            float** port = &in[j*numChannels];
+            for(int i=0; i<nframes; i++) {
+                int k;
+                for(k=0; k<ncopy; k++) {
+                    ring[i*nch+k] = port[k][i];
+                }
+                for(; k<nch; k++) {
+                    ring[i*nch+k] = 0.0f;
+                }
             }
         }
         return nframes;
@@ -181,40 +266,62 @@ private:
     int receiveFromCoreAudio(float** out, int nframes) {
         //unsigned int offset = FrameNumber % FramesPerBuffer;
         unsigned int offset = (FrameNumber - nframes) % FramesPerBuffer;
+        int nch = (int)ringChannels;
+        int ncopy = (numChannels < nch) ? numChannels : nch;
         // FIXME: should be consider buffer overwrapping
-        for(int i=0; i<nframes; i++) {
-            for(int j=0; j<NUM_OUTPUT_STREAMS; j++) {
-                out[j*2][i] = *(buf_up[j]+(offset+i)*2);
-                out[j*2+1][i] = *(buf_up[j]+(offset+i)*2+1);
-                *(buf_up[j]+(offset+i)*2) = 0.0f;
-                *(buf_up[j]+(offset+i)*2+1) = 0.0f;
+        for(int j=0; j<NUM_OUTPUT_STREAMS; j++) {
+            sample_t* ring = buf_up[j] + offset*nch;
+            float** port = &out[j*numChannels];
+            for(int i=0; i<nframes; i++) {
+                for(int k=0; k<ncopy; k++) {
+                    port[k][i] = ring[i*nch+k];
+                }
+            }
+            for(int k=ncopy; k<numChannels; k++) {
+                bzero(port[k], sizeof(sample_t)*nframes);
             }
+            bzero(ring, sizeof(sample_t)*nframes*nch);
         }
         return nframes;
     }
 
+    // Keeps the rings moving without audio: CoreAudio reads silence and
+    // what it wrote is dropped, Jack gets silence.
+    void muteCoreAudio(float** out, int nframes) {
+        int nch = (int)ringChannels;
+        for(int j=0; j<NUM_INPUT_STREAMS; j++) {
+            bzero(buf_down[j] + (FrameNumber % FramesPerBuffer)*nch, sizeof(sample_t)*nframes*nch);
+        }
+        for(int j=0; j<NUM_OUTPUT_STREAMS; j++) {
+            bzero(buf_up[j] + ((FrameNumber - nframes) % FramesPerBuffer)*nch, sizeof(sample_t)*nframes*nch);
+        }
+        for(int i=0; i<NUM_OUTPUT_STREAMS*numChannels; i++) {
+            bzero(out[i], sizeof(sample_t)*nframes);
+        }
+    }
+
     void config_audio_ports() {
-        nameAin = (char**)malloc(sizeof(char*)*(NUM_INPUT_CHANNELS+1));
-        for(int i=0; i<NUM_INPUT_CHANNELS; i++) {
-            nameAin[i] = (char*)malloc(256);
+        int nin = NUM_INPUT_STREAMS*numChannels;
+        int nout = NUM_OUTPUT_STREAMS*numChannels;
+
+        nameAin = (char**)arena_alloc(sizeof(char*)*(nin+1));
+        for(int i=0; i<nin; i++) {
+            nameAin[i] = (char*)arena_alloc(256);
             snprintf(nameAin[i], 256, "input_%d", i+1);
         }
-        nameAin[NUM_INPUT_CHANNELS] = nullptr;
+        nameAin[nin] = nullptr;
 
-        nameAout = (char**)malloc(sizeof(char*)*(NUM_OUTPUT_CHANNELS+1));
-        for(int i=0; i<NUM_OUTPUT_CHANNELS; i++) {
-            nameAout[i] = (char*)malloc(256);
+        nameAout = (char**)arena_alloc(sizeof(char*)*(nout+1));
+        for(int i=0; i<nout; i++) {
+            nameAout[i] = (char*)arena_alloc(256);
             snprintf(nameAout[i], 256, "output_%d", i+1);
         }
-        nameAout[NUM_OUTPUT_CHANNELS] = nullptr;
+        nameAout[nout] = nullptr;
     }
 
 #ifdef _WITH_MIDI_BRIDGE_
-    RtMidiOut  **midiout;
-    RtMidiIn   **midiin;
-    int nOutPorts, nInPorts;
-    char** nameMin;
-    char** nameMout;
+    MidiBridge midi;
+    MidiClockGenerator midiClock;
 
     int get_num_ports(unsigned long flags) {
         int num;
@@ -231,112 +338,39 @@ private:
         }
         return num;
     }
+#endif // _WITH_MIDI_BRIDGE_
 
-    void create_midi_ports(const char* name, int num_Min, int num_Mout) {
-        char buf[256];
-
-        // create bridge from Jack to CoreMIDI
-        nOutPorts = (num_Mout < 0) ? get_num_ports(JackPortIsOutput) : num_Mout;
-        midiout = (RtMidiOut**)malloc(sizeof(RtMidiOut*)*nOutPorts);
-        nameMin = (char**)malloc(sizeof(char*)*(nOutPorts+1));
-
-        for(int n=0; n<nOutPorts; n++) {
-            try {
-                midiout[n] = new RtMidiOut(RtMidi::MACOSX_CORE);
-                snprintf(buf, 256, "%s %d", name, n+1);
-                midiout[n]->openVirtualPort(buf);
-            } catch ( RtMidiError &error ) {
-                error.printMessage();
-                exit( EXIT_FAILURE );
-            }
-
-            nameMin[n] = (char*)malloc(256);
-            snprintf(nameMin[n], 256, "event_in_%d", n+1);
-        }
-        nameMin[nOutPorts] = NULL;
-
-        // create bridge from CoreMIDI to Jack
-        nInPorts = (num_Min < 0) ? get_num_ports(JackPortIsInput) : num_Min;
-        midiin = (RtMidiIn**)malloc(sizeof(RtMidiIn*)*nInPorts);
-        nameMout = (char**)malloc(sizeof(char*)*(nInPorts+1));
-
-        for(int n=0; n<nInPorts; n++) {
-            try {
-                midiin[n] = new RtMidiIn(RtMidi::MACOSX_CORE);
-                snprintf(buf, 256, "%s %d", name, n+1);
-                midiin[n]->openVirtualPort(buf);
-                midiin[n]->ignoreTypes(false, false, false);
-            } catch ( RtMidiError &error ) {
-                error.printMessage();
-                exit( EXIT_FAILURE );
-            }
-
-            nameMout[n] = (char*)malloc(256);
-            snprintf(nameMout[n], 256, "event_out_%d", n+1);
+    // While Jack freewheels, cycles come as fast as the CPU allows, so the
+    // time stamps handed to the driver are derived from the frame count at
+    // the nominal rate instead of mach_absolute_time(). Leaving freewheel
+    // bumps the seed so that the HAL resyncs to the host clock.
+    void update_timebase() {
+        bool request = freewheelRequest.load(std::memory_order_acquire);
+        if (request == isFreewheel) {
+            return;
         }
-        nameMout[nInPorts] = NULL;
-    }
-
-    void release_midi_ports() {
-        // release bridge from Jack to CoreMIDI
-        for(int n=0; n<nOutPorts; n++) {
-            delete midiout[n];
-            free(nameMin[n]);
+        isFreewheel = request;
+        if (isFreewheel) {
+            virtualAnchorHostTime = mach_absolute_time();
+            virtualAnchorFrame = FrameNumber;
+            *shmTimebase = JB_TIMEBASE_VIRTUAL;
+        } else {
+            *shmTimebase = JB_TIMEBASE_HOST;
+            (*shmSeed)++;
+            lastHostTime = mach_absolute_time();
         }
-        free(midiout);
-        free(nameMin);
-
-        // release bridge from CoreMIDI to Jack
-        for(int n=0; n<nInPorts; n++) {
-            delete midiin[n];
-            free(nameMout[n]);
+        if (isVerbose) {
+            printf("JackBridge#%d: %s freewheel at FRAME %llu\n",
+                instance, isFreewheel ? "Enter" : "Leave", FrameNumber);
         }
-        free(midiin);
-        free(nameMout);
     }
 
-    void process_midi_message(jack_nframes_t nframes) {
-        void *min, *mout;
-        int count;
-        jack_midi_event_t event;
-        std::vector< unsigned char > message;
-        jack_midi_data_t* buf;
-
-        // process bridge from Jack to CoreMIDI
-        for(int n=0; n<nOutPorts; n++) {
-            min = jack_port_get_buffer(midiIn[n], nframes);
-            count = jack_midi_get_event_count(min);
-            for(int i=0; i<count; i++) {
-                jack_midi_event_get(&event, min, i);
-                message.clear();
-                for (int j=0; j<event.size; j++) {
-                    message.push_back(event.buffer[j]);
-                }
-                if (message.size() > 0) {
-                    midiout[n]->sendMessage(&message);
-                }
-            }
-        }
-
-        // process bridge from CoreMIDI to Jack
-        for(int n=0; n<nInPorts; n++) {
-            mout = jack_port_get_buffer(midiOut[n], nframes);
-            jack_midi_clear_buffer(mout);
-            midiin[n]->getMessage(&message);
-            while(message.size() > 0) {
-                buf = jack_midi_event_reserve(mout, 0, message.size());
-                if (buf != NULL) {
-                    for(int i=0; i<message.size(); i++) {
-                        buf[i] = message[i];
-                    }
-                } else {
-                    fprintf(stderr, "ERROR: jack_midi_event_reserve failed()\n");
-                }
-                midiin[n]->getMessage(&message);
-            }
+    uint64_t zero_host_time() {
+        if (!isFreewheel) {
+            return mach_absolute_time();
         }
+        return virtualAnchorHostTime + (uint64_t)((FrameNumber - virtualAnchorFrame) * HostTicksPerFrame);
     }
-#endif // _WITH_MIDI_BRIDGE_
 
     void check_progress() {
 #if 0
@@ -351,7 +385,7 @@ private:
         int diff = *shmWriteFrameNumber[0] - FrameNumber;
         int interval = (mach_absolute_time() - lastHostTime) / HostTicksPerFrame;
         if (showmsg) {
-            if ((diff >= (STRBUFNUM/2))||(interval >= BufSize*2))  {
+            if ((diff >= FramesPerBuffer)||(interval >= BufSize*2))  {
                 if (isVerbose) {
                     printf("WARNING: miss synchronization detected at FRAME %llu (diff=%d, interval=%d)\n",
                         FrameNumber, diff, interval);
@@ -360,7 +394,7 @@ private:
                 showmsg = false;
             }
         } else {
-            if (diff < (STRBUFNUM/2)) {
+            if (diff < FramesPerBuffer) {
                 showmsg = true;
             }
         }
@@ -371,15 +405,40 @@ private:
 int
 main(int argc, char** argv)
 {
-    JackBridge* jackBridge[NUM_INSTANCES];
+    JackBridge* jackBridge[MAX_INSTANCES];
     int ch, num_midiIn=-1, num_midiOut=-1;
+    int num_devices=1;
     bool vflag=false;
+#ifdef _WITH_MIDI_BRIDGE_
+    bool cflag=false;
+    int mtc_fps=0;
+    double bpm=MIDI_CLOCK_DEFAULT_BPM;
+    const char* filters[MAX_MIDI_PORTS];
+    int num_filters=0;
+#endif
+    int channels=JB_DEFAULT_CHANNELS;
 
-    while ((ch = getopt(argc, argv, "vi:o:")) != -1) {
+    while ((ch = getopt(argc, argv, "vd:n:i:o:cm:b:f:")) != -1) {
         switch (ch) {
             case 'v':
                 vflag = true;
                 break;
+
+            case 'd':
+                num_devices = atoi(optarg);
+                if ((num_devices < 1) || (num_devices > MAX_INSTANCES)) {
+                    fprintf(stderr, "%s: unsupported number of devices %s (1-%d)\n", argv[0], optarg, MAX_INSTANCES);
+                    return -1;
+                }
+                break;
+
+            case 'n':
+                channels = atoi(optarg);
+                if ((channels < 1) || (channels > JB_MAX_CHANNELS)) {
+                    fprintf(stderr, "%s: unsupported number of channels %s (1-%d)\n", argv[0], optarg, JB_MAX_CHANNELS);
+                    return -1;
+                }
+                break;
 #ifdef _WITH_MIDI_BRIDGE_
             case 'i':
                 num_midiIn = atoi(optarg);
@@ -394,23 +453,77 @@ main(int argc, char** argv)
                     fprintf(stderr, "%s: exceed maximum MIDI Outputs number (> %d)\n", argv[0], MAX_MIDI_PORTS);
                 }
                 break;
+
+            case 'c':
+                cflag = true;
+                break;
+
+            case 'm':
+                mtc_fps = atoi(optarg);
+                if ((mtc_fps != 24) && (mtc_fps != 25) && (mtc_fps != 30)) {
+                    fprintf(stderr, "%s: unsupported MTC frame rate %s (24, 25 or 30)\n", argv[0], optarg);
+                    return -1;
+                }
+                break;
+
+            case 'b':
+                bpm = atof(optarg);
+                if (bpm <= 0) {
+                    fprintf(stderr, "%s: invalid tempo %s\n", argv[0], optarg);
+                    return -1;
+                }
+                break;
+
+            case 'f':
+                if (num_filters < MAX_MIDI_PORTS) {
+                    filters[num_filters++] = optarg;
+                }
+                break;
 #endif
              default:
-                fprintf(stderr, "Usage: %s [-v] [-i <# of MIDI-In>] [-o <# of MIDI-Out>]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-v] [-d <devices>] [-n <channels/stream>] [-i <# of MIDI-In>] [-o <# of MIDI-Out>] [-c] [-m <MTC fps>] [-b <bpm>] [-f [<port>:]<types>]\n", argv[0]);
                 return -1;
         }
     }
 
-    // Create instances of jack client
-    jackBridge[0] = new JackBridge("JackBridge #1", 0, num_midiIn, num_midiOut);
+    // All buffers are allocated from the arena until it is sealed
+    if (!Arena::global().init()) {
+        return -1;
+    }
+
+    // Create instances of jack client, one per device. MIDI is bridged by the first one.
+    for(int i=0; i<num_devices; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "JackBridge #%d", i+1);
+        jackBridge[i] = new JackBridge(name, i, (i == 0) ? num_midiIn : 0, (i == 0) ? num_midiOut : 0, channels);
+        if (vflag) {
+            jackBridge[i]->setVerbose(vflag);
+        }
+    }
+#ifdef _WITH_MIDI_BRIDGE_
+    jackBridge[0]->setMidiClock(cflag, mtc_fps, bpm);
+    for(int i=0; i<num_filters; i++) {
+        if (!jackBridge[0]->addMidiFilter(filters[i])) {
+            fprintf(stderr, "%s: invalid MIDI filter %s\n", argv[0], filters[i]);
+            return -1;
+        }
+    }
+    jackBridge[0]->openMidiPorts();
+#endif // _WITH_MIDI_BRIDGE_
+
+    // the driver creates or removes its devices to match
+    jackBridge[0]->set_devices(num_devices, channels);
+
+    // No more allocation from here on
+    Arena::global().seal();
     if (vflag) {
-        jackBridge[0]->setVerbose(vflag);
+        Arena::global().report(stdout);
     }
-    //jackBridge[1] = new JackBridge("JackBridge #2", 1);
 
     // activate gateway from/to jack ports
-    jackBridge[0]->activate();
-    //jackBridge[1]->activate();
+    for(int i=0; i<num_devices; i++) {
+        jackBridge[i]->activate();
+    }
 
     // Infinite loop until daemon is killed.
     while(1) {
@@ -0,0 +1 @@
+../libs/arena.hpp
\ No newline at end of file
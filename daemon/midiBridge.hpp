@@ -0,0 +1,241 @@
+/*
+ File: midiBridge.hpp
+
+MIT License
+
+Copyright (c) 2016-2018 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <rtmidi/RtMidi.h>
+#include "midiFilter.hpp"
+#include "midiQueue.hpp"
+#include "midiEvents.hpp"
+#include "arena.hpp"
+
+#define MAX_MIDI_PORTS 256
+
+/******************************************************************************
+ MIDI bridge between Jack MIDI ports and CoreMIDI virtual ports
+ (kept apart from JackBridge so that it can be driven by tools/bench)
+******************************************************************************/
+class MidiBridge {
+public:
+    int nOutPorts, nInPorts;
+    char** nameMin;
+    char** nameMout;
+
+    MidiBridge() : nOutPorts(0), nInPorts(0), nameMin(NULL), nameMout(NULL),
+                   midiout(NULL), midiin(NULL), inputsOpen(false) {
+        portName[0] = '\0';
+    }
+
+    ~MidiBridge() {
+        release_ports();
+    }
+
+    // nOut: number of bridges from Jack to CoreMIDI
+    // nIn : number of bridges from CoreMIDI to Jack
+    // The CoreMIDI inputs are opened by open_ports(), after the filters are set.
+    void create_ports(const char* name, int nIn, int nOut) {
+        char buf[256];
+
+        // create bridge from Jack to CoreMIDI
+        nOutPorts = nOut;
+        midiout = (RtMidiOut**)arena_alloc(sizeof(RtMidiOut*)*nOutPorts);
+        nameMin = (char**)arena_alloc(sizeof(char*)*(nOutPorts+1));
+
+        for(int n=0; n<nOutPorts; n++) {
+            try {
+                midiout[n] = new RtMidiOut(RtMidi::MACOSX_CORE);
+                snprintf(buf, 256, "%s %d", name, n+1);
+                midiout[n]->openVirtualPort(buf);
+            } catch ( RtMidiError &error ) {
+                error.printMessage();
+                exit( EXIT_FAILURE );
+            }
+
+            nameMin[n] = (char*)arena_alloc(256);
+            snprintf(nameMin[n], 256, "event_in_%d", n+1);
+        }
+        nameMin[nOutPorts] = NULL;
+
+        // create bridge from CoreMIDI to Jack
+        nInPorts = nIn;
+        snprintf(portName, sizeof(portName), "%s", name);
+        midiin = arena_new_array<midiInput_t>(nInPorts);
+        nameMout = (char**)arena_alloc(sizeof(char*)*(nInPorts+1));
+
+        for(int n=0; n<nInPorts; n++) {
+            midiin[n].queue = arena_new_array<MidiQueue>(1);
+            try {
+                midiin[n].port = new RtMidiIn(RtMidi::MACOSX_CORE);
+                midiin[n].port->setCallback(&MidiBridge::_receive_callback, &midiin[n]);
+                midiin[n].port->ignoreTypes(false, false, false);
+            } catch ( RtMidiError &error ) {
+                error.printMessage();
+                exit( EXIT_FAILURE );
+            }
+
+            nameMout[n] = (char*)arena_alloc(256);
+            snprintf(nameMout[n], 256, "event_out_%d", n+1);
+        }
+        nameMout[nInPorts] = NULL;
+    }
+
+    // Opens the CoreMIDI inputs, RtMidi's input thread delivers from then on
+    void open_ports() {
+        char buf[256];
+
+        for(int n=0; n<nInPorts; n++) {
+            try {
+                snprintf(buf, 256, "%s %d", portName, n+1);
+                midiin[n].port->openVirtualPort(buf);
+            } catch ( RtMidiError &error ) {
+                error.printMessage();
+                exit( EXIT_FAILURE );
+            }
+        }
+        inputsOpen = true;
+    }
+
+    void release_ports() {
+        // release bridge from Jack to CoreMIDI
+        for(int n=0; n<nOutPorts; n++) {
+            delete midiout[n];
+            arena_free(nameMin[n]);
+        }
+        arena_free(midiout);
+        arena_free(nameMin);
+
+        // release bridge from CoreMIDI to Jack
+        for(int n=0; n<nInPorts; n++) {
+            delete midiin[n].port;
+            arena_delete_array(midiin[n].queue, 1);
+            arena_free(nameMout[n]);
+        }
+        arena_delete_array(midiin, nInPorts);
+        arena_free(nameMout);
+
+        midiout = NULL;
+        midiin = NULL;
+        nameMin = nameMout = NULL;
+        nOutPorts = nInPorts = 0;
+        inputsOpen = false;
+    }
+
+    // Drops the given types of events received from CoreMIDI.
+    // spec: "[<port>:]<type>[,<type>...]", all ports if <port> is omitted.
+    // See MidiFilter::drop() for the type names. Only between create_ports()
+    // and open_ports(), RtMidi's input thread reads the filters afterwards.
+    // Returns false, with no port changed, if spec is invalid.
+    bool add_filter(const char* spec) {
+        if (inputsOpen) {
+            return false;
+        }
+        int first = 0, last = nInPorts - 1;
+        const char* colon = strchr(spec, ':');
+        if (colon != NULL) {
+            int port = atoi(spec);
+            if ((port < 1) || (port > nInPorts)) {
+                return false;
+            }
+            first = last = port - 1;
+            spec = colon + 1;
+        }
+        MidiFilter types;
+        if (!types.drop(spec)) {
+            return false;
+        }
+        for(int n=first; n<=last; n++) {
+            midiin[n].filter.drop(types);
+            // let RtMidi skip whole classes already in its parser
+            const MidiFilter& f = midiin[n].filter;
+            midiin[n].port->ignoreTypes(!f.accepts(0xf0),
+                                        !f.accepts(0xf1) && !f.accepts(0xf8),
+                                        !f.accepts(0xfe));
+        }
+        return true;
+    }
+
+    // Called from Jack process callback.
+    // events are this cycle's Jack input events sorted by time (see
+    // MidiEventBatch), events[i].port is bridged to CoreMIDI port #port.
+    // CoreMIDI port #n is bridged to the Jack port whose buffer is jackOut[n].
+    void process(const midiEvent_t* events, int count, void* const* jackOut) {
+        void *mout;
+        size_t size;
+        jack_midi_data_t* buf;
+
+        // process bridge from Jack to CoreMIDI
+        // every message is a CoreMIDI packet of its own, which has to start
+        // with a status byte, so running status isn't used here
+        for(int i=0; i<count; i++) {
+            const midiEvent_t& ev = events[i];
+            if ((ev.port < nOutPorts) && (ev.size > 0)) {
+                midiout[ev.port]->sendMessage(ev.data, ev.size);
+            }
+        }
+
+        // process bridge from CoreMIDI to Jack
+        for(int n=0; n<nInPorts; n++) {
+            mout = jackOut[n];
+            jack_midi_clear_buffer(mout);
+            while((size = midiin[n].queue->peek()) > 0) {
+                buf = jack_midi_event_reserve(mout, 0, size);
+                if (buf == NULL) {
+                    fprintf(stderr, "ERROR: jack_midi_event_reserve failed()\n");
+                }
+                midiin[n].queue->pop(buf);
+            }
+        }
+    }
+
+    RtMidiIn* input_port(int n) {
+        return midiin[n].port;
+    }
+
+private:
+    typedef struct midiInput {
+        RtMidiIn*   port;
+        MidiFilter  filter;
+        MidiQueue*  queue;
+    } midiInput_t;
+
+    RtMidiOut             **midiout;
+    midiInput_t           *midiin;
+    char                  portName[128];
+    bool                  inputsOpen;
+
+    // Called from the CoreMIDI receive thread
+    static void _receive_callback(double timeStamp, std::vector<unsigned char>* message, void* arg) {
+        midiInput_t* in = (midiInput_t*)arg;
+        (void)timeStamp;
+        if ((message->size() > 0) && in->filter.accepts((*message)[0])) {
+            in->queue->push(message->data(), message->size());
+        }
+    }
+};
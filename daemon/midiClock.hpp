@@ -0,0 +1,306 @@
+/*
+ File: midiClock.hpp
+
+MIT License
+
+Copyright (c) 2016-2018 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+#include <stdint.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+/******************************************************************************
+ MIDI Clock / MIDI Time Code generator driven by Jack transport
+
+ All schedules are kept as "whole frames + remainder/den" relative to the
+ start of the current period, so they never drift against the frame clock.
+******************************************************************************/
+#define MIDI_CLOCK_PPQN         24
+#define MIDI_CLOCK_MAX_EVENTS   256
+#define MIDI_CLOCK_DEFAULT_BPM  120.0
+
+class MidiClockGenerator {
+public:
+    typedef struct {
+        jack_nframes_t  time;
+        int             size;
+        unsigned char   data[10];
+    } clockEvent_t;
+
+    MidiClockGenerator() : clockEnabled(false), mtcFps(0), sampleRate(48000),
+                           defaultBpmMilli(120000), rolling(false), expectedFrame(0), nevents(0) {
+        bpmMilli = defaultBpmMilli;
+        tick.set(0, 1);
+        qf.set(0, 1);
+    }
+
+    void enable_clock(bool flag) {
+        clockEnabled = flag;
+    }
+
+    // fps: 24, 25 or 30 (non-drop). 0 disables MTC.
+    bool enable_mtc(int fps) {
+        if ((fps != 0) && (fps != 24) && (fps != 25) && (fps != 30)) {
+            return false;
+        }
+        mtcFps = fps;
+        return true;
+    }
+
+    void set_default_tempo(double bpm) {
+        if (bpm > 0) {
+            defaultBpmMilli = (uint64_t)(bpm * 1000.0 + 0.5);
+        }
+    }
+
+    void set_sample_rate(jack_nframes_t rate) {
+        sampleRate = rate;
+    }
+
+    bool is_enabled() const {
+        return clockEnabled || (mtcFps != 0);
+    }
+
+    // Computes this period's messages. Must be called once per process cycle.
+    void process(jack_transport_state_t state, const jack_position_t* pos, jack_nframes_t nframes) {
+        bool nowRolling = (state == JackTransportRolling);
+        nevents = 0;
+
+        if (nowRolling && (!rolling || (pos->frame != expectedFrame))) {
+            start(pos, rolling);
+        } else if (!nowRolling && rolling) {
+            if (clockEnabled) {
+                push(0, 0xfc); // Stop
+            }
+        }
+        rolling = nowRolling;
+        expectedFrame = pos->frame + (rolling ? nframes : 0);
+
+        if (!rolling) {
+            return;
+        }
+
+        if (clockEnabled) {
+            update_tempo(pos);
+        }
+
+        // merge both schedules in time order
+        while (true) {
+            bool haveTick = clockEnabled && (tick.frame < nframes);
+            bool haveQF = (mtcFps != 0) && (qf.frame < nframes);
+            if (!haveTick && !haveQF) {
+                break;
+            }
+            if (haveTick && (!haveQF || (tick.frame <= qf.frame))) {
+                push((jack_nframes_t)tick.frame, 0xf8); // Timing Clock
+                tick.advance(tickStep, tickStepRem);
+            } else {
+                push((jack_nframes_t)qf.frame, 0xf1, quarter_frame_data());
+                qf.advance(qfStep, qfStepRem);
+            }
+        }
+        tick.frame -= (clockEnabled ? nframes : 0);
+        qf.frame -= ((mtcFps != 0) ? nframes : 0);
+    }
+
+    // Writes the messages computed by process() into a Jack MIDI port buffer.
+    // The buffer may already hold events at time 0.
+    void write(void* portBuffer) const {
+        for (int i=0; i<nevents; i++) {
+            jack_midi_event_write(portBuffer, events[i].time, events[i].data, events[i].size);
+        }
+    }
+
+private:
+    // position in frames relative to the current period plus rem/den
+    struct schedule {
+        int64_t  frame;
+        uint64_t rem;
+        uint64_t den;
+
+        void set(int64_t _frame, uint64_t _den) {
+            frame = _frame;
+            rem = 0;
+            den = _den;
+        }
+        void advance(uint64_t step, uint64_t stepRem) {
+            frame += step;
+            rem += stepRem;
+            if (rem >= den) {
+                rem -= den;
+                frame++;
+            }
+        }
+    };
+
+    bool            clockEnabled;
+    int             mtcFps;
+    jack_nframes_t  sampleRate;
+    uint64_t        defaultBpmMilli;
+    uint64_t        bpmMilli;
+    bool            rolling;
+    jack_nframes_t  expectedFrame;
+
+    schedule        tick;
+    uint64_t        tickStep, tickStepRem;
+    schedule        qf;
+    uint64_t        qfStep, qfStepRem;
+    int             qfPiece;
+    uint32_t        mtcFrame;   // timecode (in frames) sent with the current 8 pieces
+
+    clockEvent_t    events[MIDI_CLOCK_MAX_EVENTS];
+    int             nevents;
+
+    void push(jack_nframes_t time, unsigned char status, int data = -1) {
+        if (nevents >= MIDI_CLOCK_MAX_EVENTS) {
+            return;
+        }
+        events[nevents].time = time;
+        events[nevents].data[0] = status;
+        events[nevents].size = 1;
+        if (data >= 0) {
+            events[nevents].data[1] = data & 0x7f;
+            events[nevents].size = 2;
+        }
+        nevents++;
+    }
+
+    uint64_t tempo_of(const jack_position_t* pos) const {
+        if ((pos->valid & JackPositionBBT) && (pos->beats_per_minute > 0)) {
+            return (uint64_t)(pos->beats_per_minute * 1000.0 + 0.5);
+        }
+        return defaultBpmMilli;
+    }
+
+    // frames per tick = sampleRate*60 / (bpm*24) = sampleRate*60000 / (bpmMilli*24)
+    void set_tick_step() {
+        uint64_t num = (uint64_t)sampleRate * 60000;
+        uint64_t den = bpmMilli * MIDI_CLOCK_PPQN;
+        tickStep = num / den;
+        tickStepRem = num % den;
+    }
+
+    void update_tempo(const jack_position_t* pos) {
+        uint64_t newBpm = tempo_of(pos);
+        if (newBpm != bpmMilli) {
+            // keep the phase of the pending tick, rescale its remainder
+            uint64_t newDen = newBpm * MIDI_CLOCK_PPQN;
+            tick.rem = tick.rem * newDen / tick.den;
+            tick.den = newDen;
+            bpmMilli = newBpm;
+            set_tick_step();
+        }
+    }
+
+    void start(const jack_position_t* pos, bool relocate) {
+        if (clockEnabled) {
+            bpmMilli = tempo_of(pos);
+            set_tick_step();
+            tick.set(0, bpmMilli * MIDI_CLOCK_PPQN);
+
+            if ((pos->frame == 0) && !relocate) {
+                push(0, 0xfa); // Start
+            } else {
+                if (relocate) {
+                    push(0, 0xfc); // Stop before repositioning
+                }
+                if (pos->valid & JackPositionBBT) {
+                    // Song Position Pointer counts MIDI beats (sixteenth notes)
+                    int beatsPerBar = (int)pos->beats_per_bar;
+                    uint32_t spp = ((pos->bar - 1) * beatsPerBar + (pos->beat - 1)) * 4;
+                    if (pos->ticks_per_beat > 0) {
+                        spp += (uint32_t)(pos->tick * 4 / pos->ticks_per_beat);
+                    }
+                    if (nevents < MIDI_CLOCK_MAX_EVENTS) {
+                        events[nevents].time = 0;
+                        events[nevents].data[0] = 0xf2;
+                        events[nevents].data[1] = spp & 0x7f;
+                        events[nevents].data[2] = (spp >> 7) & 0x7f;
+                        events[nevents].size = 3;
+                        nevents++;
+                    }
+                }
+                push(0, 0xfb); // Continue
+            }
+        }
+
+        if (mtcFps != 0) {
+            // align the first piece to an even frame at or after the current position
+            uint64_t qfDen = (uint64_t)mtcFps * 4;
+            uint64_t q = ((uint64_t)pos->frame * qfDen + sampleRate - 1) / sampleRate;
+            q = (q + 7) & ~(uint64_t)7;
+            uint64_t offset = q * sampleRate - (uint64_t)pos->frame * qfDen;
+            qf.set(offset / qfDen, qfDen);
+            qf.rem = offset % qfDen;
+            qfStep = sampleRate / qfDen;
+            qfStepRem = sampleRate % qfDen;
+            qfPiece = 0;
+            mtcFrame = (uint32_t)(q / 4);
+            full_frame();
+        }
+    }
+
+    // MTC full frame message so that receivers locate immediately
+    void full_frame() {
+        if (nevents >= MIDI_CLOCK_MAX_EVENTS) {
+            return;
+        }
+        unsigned char* d = events[nevents].data;
+        d[0] = 0xf0; d[1] = 0x7f; d[2] = 0x7f; d[3] = 0x01; d[4] = 0x01;
+        d[5] = (rate_code() << 5) | hours();
+        d[6] = minutes();
+        d[7] = seconds();
+        d[8] = frames();
+        d[9] = 0xf7;
+        events[nevents].time = 0;
+        events[nevents].size = 10;
+        nevents++;
+    }
+
+    int rate_code() const {
+        return (mtcFps == 24) ? 0 : (mtcFps == 25) ? 1 : 3;
+    }
+    int hours() const   { return (mtcFrame / (mtcFps * 3600)) % 24; }
+    int minutes() const { return (mtcFrame / (mtcFps * 60)) % 60; }
+    int seconds() const { return (mtcFrame / mtcFps) % 60; }
+    int frames() const  { return mtcFrame % mtcFps; }
+
+    int quarter_frame_data() {
+        int value;
+        switch (qfPiece) {
+            case 0: value = frames() & 0x0f; break;
+            case 1: value = frames() >> 4; break;
+            case 2: value = seconds() & 0x0f; break;
+            case 3: value = seconds() >> 4; break;
+            case 4: value = minutes() & 0x0f; break;
+            case 5: value = minutes() >> 4; break;
+            case 6: value = hours() & 0x0f; break;
+            default: value = (hours() >> 4) | (rate_code() << 1); break;
+        }
+        int data = (qfPiece << 4) | value;
+        if (++qfPiece == 8) {
+            qfPiece = 0;
+            mtcFrame += 2;
+        }
+        return data;
+    }
+};
@@ -0,0 +1 @@
+../libs/midiEvents.hpp
\ No newline at end of file
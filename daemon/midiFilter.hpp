@@ -0,0 +1,126 @@
+/*
+ File: midiFilter.hpp
+
+MIT License
+
+Copyright (c) 2016-2018 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+#include <stdint.h>
+#include <cstring>
+#include <cstdlib>
+
+/******************************************************************************
+ Per-port MIDI event filter
+
+ The filter is a 256 bit table indexed by status byte. It is evaluated in the
+ MIDI receive thread, so dropped events never reach the Jack process callback.
+ The table is only changed before the port is opened (see MidiBridge).
+******************************************************************************/
+class MidiFilter {
+public:
+    MidiFilter() {
+        clear();
+    }
+
+    // pass everything
+    void clear() {
+        memset(table, 0, sizeof(table));
+    }
+
+    bool accepts(unsigned char status) const {
+        return (table[status >> 5] & (1u << (status & 31))) == 0;
+    }
+
+    // Drops the types of another filter too
+    void drop(const MidiFilter& f) {
+        for (int i=0; i<8; i++) {
+            table[i] |= f.table[i];
+        }
+    }
+
+    // Drops the types listed in spec, a comma separated list of:
+    //   note, polyat, cc, pc, at, pb, voice (all channel voice messages),
+    //   sysex, mtc, spp, song, tune, common (all system common messages),
+    //   clock, start, continue, stop, sense, reset, realtime (all real time)
+    // Returns false, with the filter unchanged, if spec has an unknown type.
+    bool drop(const char* spec) {
+        uint32_t t[8];
+        memcpy(t, table, sizeof(t));
+        const char* p = spec;
+        while (*p) {
+            const char* end = strchr(p, ',');
+            size_t len = end ? (size_t)(end - p) : strlen(p);
+            unsigned char first, last;
+            if (!lookup(p, len, &first, &last)) {
+                return false;
+            }
+            for (int s=first; s<=last; s++) {
+                t[s >> 5] |= 1u << (s & 31);
+            }
+            p += len;
+            if (*p == ',') {
+                p++;
+            }
+        }
+        memcpy(table, t, sizeof(t));
+        return true;
+    }
+
+private:
+    uint32_t table[8];
+
+    static bool lookup(const char* name, size_t len, unsigned char* first, unsigned char* last) {
+        static const struct {
+            const char* name;
+            unsigned char first, last;
+        } types[] = {
+            { "note",     0x80, 0x9f },
+            { "polyat",   0xa0, 0xaf },
+            { "cc",       0xb0, 0xbf },
+            { "pc",       0xc0, 0xcf },
+            { "at",       0xd0, 0xdf },
+            { "pb",       0xe0, 0xef },
+            { "voice",    0x80, 0xef },
+            { "sysex",    0xf0, 0xf0 },
+            { "mtc",      0xf1, 0xf1 },
+            { "spp",      0xf2, 0xf2 },
+            { "song",     0xf3, 0xf3 },
+            { "tune",     0xf6, 0xf6 },
+            { "common",   0xf0, 0xf7 },
+            { "clock",    0xf8, 0xf8 },
+            { "start",    0xfa, 0xfa },
+            { "continue", 0xfb, 0xfb },
+            { "stop",     0xfc, 0xfc },
+            { "sense",    0xfe, 0xfe },
+            { "reset",    0xff, 0xff },
+            { "realtime", 0xf8, 0xff },
+        };
+        for (size_t i=0; i<sizeof(types)/sizeof(types[0]); i++) {
+            if ((strlen(types[i].name) == len) && (strncmp(types[i].name, name, len) == 0)) {
+                *first = types[i].first;
+                *last = types[i].last;
+                return true;
+            }
+        }
+        return false;
+    }
+};
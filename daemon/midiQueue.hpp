@@ -0,0 +1,99 @@
+/*
+ File: midiQueue.hpp
+
+MIT License
+
+Copyright (c) 2016-2018 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#pragma once
+#include <stdint.h>
+#include <cstdlib>
+#include <atomic>
+
+/******************************************************************************
+ Single producer / single consumer queue of variable length MIDI messages
+
+ The producer is the MIDI receive thread, the consumer is the Jack process
+ callback. Each record is a 16 bit length followed by the message bytes and
+ may wrap around the end of the buffer. Neither side allocates or locks.
+******************************************************************************/
+#define MIDI_QUEUE_SIZE (64*1024) // must be power of 2
+
+class MidiQueue {
+public:
+    MidiQueue() : wptr(0), rptr(0), dropped(0) {
+    }
+
+    // producer side
+    bool push(const unsigned char* msg, size_t size) {
+        uint32_t w = wptr.load(std::memory_order_relaxed);
+        uint32_t r = rptr.load(std::memory_order_acquire);
+        if ((size > 0xffff) || (size + 2 > MIDI_QUEUE_SIZE - (w - r))) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        put(w, (unsigned char)(size & 0xff));
+        put(w+1, (unsigned char)(size >> 8));
+        for (size_t i=0; i<size; i++) {
+            put(w+2+i, msg[i]);
+        }
+        wptr.store(w + 2 + (uint32_t)size, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side: size of the next message, 0 if empty
+    size_t peek() const {
+        uint32_t r = rptr.load(std::memory_order_relaxed);
+        if (r == wptr.load(std::memory_order_acquire)) {
+            return 0;
+        }
+        return get(r) | (get(r+1) << 8);
+    }
+
+    // consumer side: copies the next message into dst (NULL discards it)
+    void pop(unsigned char* dst) {
+        uint32_t r = rptr.load(std::memory_order_relaxed);
+        size_t size = get(r) | (get(r+1) << 8);
+        if (dst != NULL) {
+            for (size_t i=0; i<size; i++) {
+                dst[i] = get(r+2+i);
+            }
+        }
+        rptr.store(r + 2 + (uint32_t)size, std::memory_order_release);
+    }
+
+    uint32_t dropped_count() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    unsigned char buf[MIDI_QUEUE_SIZE];
+    std::atomic<uint32_t> wptr;
+    std::atomic<uint32_t> rptr;
+    std::atomic<uint32_t> dropped;
+
+    void put(uint32_t pos, unsigned char c) {
+        buf[pos & (MIDI_QUEUE_SIZE-1)] = c;
+    }
+    unsigned char get(uint32_t pos) const {
+        return buf[pos & (MIDI_QUEUE_SIZE-1)];
+    }
+};
@@ -0,0 +1 @@
+../libs/ump.hpp
\ No newline at end of file
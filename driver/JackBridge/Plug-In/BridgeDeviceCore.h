@@ -0,0 +1,422 @@
+/*
+ File: BridgeDeviceCore.h
+
+ MIT License
+
+ Copyright (c) 2018 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <limits>
+#include "GracePeriod.h"
+
+/******************************************************************************
+ IO core of the JackBridge device
+
+ Ring indexing, wrap-split copies, frame counter publication and the zero
+ time stamp math of SA_Device, free of CoreAudio and mach types so that it
+ can be driven on any platform (see tools/bench/drivercorebench.cpp).
+ Everything refers to the shared memory through the pointers given by the
+ attach_*() functions, host times are passed in by the caller. All rings
+ carry interleaved float32 frames of the same number of channels.
+
+ Every stream has a linear gain applied while copying (volume and mute
+ controls). A new gain is reached with a ramp over the next IO buffer of
+ the stream, unity gain is a plain memcpy.
+
+ The first stream of each direction measures how far its IO is from the
+ daemon's position (margins). update_latency() turns them into the safety
+ offset and the latency the device reports.
+
+ The IO functions never block. Configuration is written by one thread at
+ a time (the caller serializes, SA_Device holds its state mutex): set_*()
+ stage values and commit() publishes them as one immutable snapshot with an
+ atomic pointer, start() publishes at once. The IO functions load the
+ pointer once per call inside a grace period, and a publication waits for
+ the calls that may still read the previous snapshot before its slot is
+ written again, so two slots are enough however often it is changed.
+******************************************************************************/
+#define BRIDGE_CORE_MAX_STREAMS     8
+#define BRIDGE_CORE_CHANNELS        2   // default channels per frame
+#define BRIDGE_CORE_CONFIG_SLOTS    2
+#define BRIDGE_CORE_SAFETY_FRAMES   16  // margin kept on top of the worst one measured
+
+class BridgeDeviceCore {
+public:
+    typedef float sample_t;
+
+    BridgeDeviceCore() : nextSlot(1), ioGeneration(0), numberTimeStamps(0), daemonFrame(NULL), jackPeriod(NULL) {
+        memset(input, 0, sizeof(input));
+        memset(output, 0, sizeof(output));
+        memset(&timebase, 0, sizeof(timebase));
+        memset(slots, 0, sizeof(slots));
+        memset(&pending, 0, sizeof(pending));
+        pending.channels = BRIDGE_CORE_CHANNELS;
+        slots[0] = pending;
+        config.store(&slots[0]);
+        for (int i=0; i<BRIDGE_CORE_MAX_STREAMS; i++) {
+            inputGain[i].store(1.0f);
+            outputGain[i].store(1.0f);
+            inputLevel[i] = outputLevel[i] = 1.0f;
+        }
+        reset(inputMargin);
+        reset(outputMargin);
+    }
+
+    // ring: interleaved ring of ringFrames frames
+    // frameNumber: shm register receiving the sample time after each IO
+    void attach_input(int stream, sample_t* ring, volatile uint64_t* frameNumber) {
+        input[stream].ring = ring;
+        input[stream].frameNumber = frameNumber;
+    }
+
+    void attach_output(int stream, sample_t* ring, volatile uint64_t* frameNumber) {
+        output[stream].ring = ring;
+        output[stream].frameNumber = frameNumber;
+    }
+
+    void attach_timebase(volatile uint64_t* numberTimeStamps, volatile uint64_t* zeroHostTime,
+                         volatile uint64_t* seed, volatile uint64_t* syncMode) {
+        timebase.numberTimeStamps = numberTimeStamps;
+        timebase.zeroHostTime = zeroHostTime;
+        timebase.seed = seed;
+        timebase.syncMode = syncMode;
+    }
+
+    // frameNumber: shm register of the daemon's position after its last cycle
+    // period: shm register of the Jack period
+    void attach_daemon(volatile uint64_t* frameNumber, volatile uint64_t* period) {
+        daemonFrame = frameNumber;
+        jackPeriod = period;
+    }
+
+    void set_ring_frames(uint32_t frames) {
+        pending.ringFrames = frames;
+    }
+
+    uint32_t ring_frames() const {
+        return pending.ringFrames;
+    }
+
+    // Frames between two zero time stamps, 0 means one per ring
+    void set_period_frames(uint32_t frames) {
+        pending.periodFrames = frames;
+    }
+
+    // Channels per frame and ring size change together
+    void set_format(uint32_t channels, uint32_t frames) {
+        pending.channels = channels;
+        pending.ringFrames = frames;
+    }
+
+    uint32_t channels() const {
+        return pending.channels;
+    }
+
+    // Linear gain of a stream, may be called from any thread
+    void set_input_gain(int stream, float gain) {
+        inputGain[stream].store(gain, std::memory_order_relaxed);
+    }
+
+    void set_output_gain(int stream, float gain) {
+        outputGain[stream].store(gain, std::memory_order_relaxed);
+    }
+
+    void set_host_ticks_per_frame(double ticks) {
+        pending.hostTicksPerFrame = ticks;
+    }
+
+    // Publishes the set_*() calls since the last publication, once per
+    // configuration change. Waits for IO calls in progress.
+    void commit() {
+        publish();
+    }
+
+    // Called when IO starts, time stamps count from anchorHost.
+    // The IO thread restarts its time stamp count when it sees it.
+    void start(uint64_t anchorHost) {
+        pending.anchorHostTime = anchorHost;
+        pending.generation++;
+        publish();
+        reset(inputMargin);     // IO isn't running yet
+        reset(outputMargin);
+    }
+
+    // Copies nframes at sampleTime from the downstream ring of the stream
+    void read_input(int stream, uint32_t nframes, double sampleTime, void* outBuffer) {
+        const stream_t& s = input[stream];
+        int reader = grace.enter();
+        const ioConfig_t* c = config.load(std::memory_order_acquire);
+        uint32_t offset = static_cast<uint64_t>(sampleTime) % c->ringFrames;
+        uint32_t first = split(offset, nframes, c->ringFrames);
+        float gain, step;
+        ramp(inputLevel[stream], inputGain[stream], nframes, gain, step);
+
+        sample_t* dst = reinterpret_cast<sample_t*>(outBuffer);
+        copy_frames(dst, s.ring + offset*c->channels, first, c->channels, gain, step);
+        if (first < nframes) {
+            copy_frames(dst + first*c->channels, s.ring, nframes - first, c->channels, gain + step*first, step);
+        }
+        *s.frameNumber = static_cast<uint64_t>(sampleTime) + nframes;
+
+        // frames the daemon has written beyond the ones read
+        if ((stream == 0) && (daemonFrame != NULL)) {
+            measure(inputMargin, static_cast<int64_t>(*daemonFrame) - static_cast<int64_t>(*s.frameNumber), c->ringFrames);
+        }
+        grace.leave(reader);
+    }
+
+    // Copies nframes at sampleTime into the upstream ring of the stream
+    void write_output(int stream, uint32_t nframes, double sampleTime, const void* inBuffer) {
+        const stream_t& s = output[stream];
+        int reader = grace.enter();
+        const ioConfig_t* c = config.load(std::memory_order_acquire);
+        uint32_t offset = static_cast<uint64_t>(sampleTime) % c->ringFrames;
+        uint32_t first = split(offset, nframes, c->ringFrames);
+        float gain, step;
+        ramp(outputLevel[stream], outputGain[stream], nframes, gain, step);
+
+        const sample_t* src = reinterpret_cast<const sample_t*>(inBuffer);
+        copy_frames(s.ring + offset*c->channels, src, first, c->channels, gain, step);
+        if (first < nframes) {
+            copy_frames(s.ring, src + first*c->channels, nframes - first, c->channels, gain + step*first, step);
+        }
+        *s.frameNumber = static_cast<uint64_t>(sampleTime) + nframes;
+
+        // frames written ahead of the daemon, whose next cycle reads from one
+        // Jack period before its position
+        if ((stream == 0) && (daemonFrame != NULL)) {
+            measure(outputMargin, static_cast<int64_t>(sampleTime) - (static_cast<int64_t>(*daemonFrame) - static_cast<int64_t>(*jackPeriod)), c->ringFrames);
+        }
+        grace.leave(reader);
+    }
+
+    typedef struct {
+        uint32_t    safetyOffset;   // frames kept from the daemon's position
+        uint32_t    latency;        // frames the ring holds on top of that on average
+    } latency_t;
+
+    // Folds the margins measured since the last call into the values of both
+    // directions. The margins include the safety offset the HAL applies
+    // (applied), so a safety offset follows a deficit at once and gives a
+    // quarter of the spare frames back per call. The latency is a running
+    // average of the frames beyond the applied safety offset. Returns true
+    // if a value changed. Called by the configuring thread, not the IO thread.
+    bool update_latency(const latency_t& inputApplied, const latency_t& outputApplied,
+                        latency_t& ioInput, latency_t& ioOutput) {
+        bool changed = update_latency(inputMargin, pending.ringFrames, inputApplied, ioInput);
+        changed |= update_latency(outputMargin, pending.ringFrames, outputApplied, ioOutput);
+        return changed;
+    }
+
+    // Drops the margins measured so far, after the HAL got new values
+    void discard_margins() {
+        reset(inputMargin);
+        reset(outputMargin);
+    }
+
+    // One time stamp per period (see set_period_frames()). With sync mode
+    // the daemon provides them in the shm, otherwise they are derived from
+    // the host clock (now) and published for the daemon.
+    void get_zero_time_stamp(uint64_t now, double& outSampleTime, uint64_t& outHostTime, uint64_t& outSeed) {
+        int reader = grace.enter();
+        const ioConfig_t* c = config.load(std::memory_order_acquire);
+        if (c->generation != ioGeneration) {
+            ioGeneration = c->generation;
+            numberTimeStamps = 0;
+        }
+        uint32_t periodFrames = (c->periodFrames != 0) ? c->periodFrames : c->ringFrames;
+        uint64_t anchorHostTime = c->anchorHostTime;
+        double ticksPerPeriod = c->hostTicksPerFrame * ((double)periodFrames);
+        double offset = ((double)(numberTimeStamps + 1)) * ticksPerPeriod;
+        uint64_t nextHostTime = anchorHostTime + ((uint64_t)offset);
+        //  go to the next time if the next host time is less than the current time
+        if (nextHostTime <= now) {
+            ++numberTimeStamps;
+        }
+
+        if (*timebase.syncMode == 1) {
+            outSampleTime = (*timebase.numberTimeStamps) * periodFrames;
+            outHostTime = *timebase.zeroHostTime;
+        } else {
+            outSampleTime = numberTimeStamps * periodFrames;
+            outHostTime = anchorHostTime + (((double)numberTimeStamps) * ticksPerPeriod);
+            *timebase.numberTimeStamps = numberTimeStamps;
+            *timebase.zeroHostTime = outHostTime;
+        }
+        outSeed = *timebase.seed;
+        grace.leave(reader);
+    }
+
+private:
+    typedef struct {
+        sample_t*           ring;
+        volatile uint64_t*  frameNumber;
+    } stream_t;
+
+    // Written by the IO thread, reset by update_latency(). The minimum is
+    // lowered with compare_exchange, which the IO thread retries at most
+    // once per reset.
+    typedef struct {
+        std::atomic<int64_t>    minimum;
+        std::atomic<int64_t>    sum;
+        std::atomic<uint32_t>   cycles;
+    } margin_t;
+
+    typedef struct {
+        volatile uint64_t*  numberTimeStamps;
+        volatile uint64_t*  zeroHostTime;
+        volatile uint64_t*  seed;
+        volatile uint64_t*  syncMode;
+    } timebase_t;
+
+    typedef struct {
+        uint32_t    ringFrames;
+        uint32_t    periodFrames;   // of the time stamps, 0: ringFrames
+        uint32_t    channels;
+        double      hostTicksPerFrame;
+        uint64_t    anchorHostTime;
+        uint64_t    generation;     // bumped by start()
+    } ioConfig_t;
+
+    stream_t    input[BRIDGE_CORE_MAX_STREAMS];
+    stream_t    output[BRIDGE_CORE_MAX_STREAMS];
+    timebase_t  timebase;
+
+    // written by the configuring thread only
+    ioConfig_t  pending;
+    ioConfig_t  slots[BRIDGE_CORE_CONFIG_SLOTS];
+    int         nextSlot;
+    std::atomic<const ioConfig_t*> config;
+    GracePeriod grace;      // IO calls reading config
+
+    // gains requested by the controls
+    std::atomic<float> inputGain[BRIDGE_CORE_MAX_STREAMS];
+    std::atomic<float> outputGain[BRIDGE_CORE_MAX_STREAMS];
+
+    // owned by the IO thread
+    uint64_t    ioGeneration;
+    uint64_t    numberTimeStamps;
+    volatile uint64_t*  daemonFrame;
+    volatile uint64_t*  jackPeriod;
+    margin_t    inputMargin;
+    margin_t    outputMargin;
+    float       inputLevel[BRIDGE_CORE_MAX_STREAMS];    // gain reached by the last IO
+    float       outputLevel[BRIDGE_CORE_MAX_STREAMS];
+
+    // The slot written next is the one replaced here, free once the IO
+    // calls that may have loaded it have left.
+    void publish() {
+        slots[nextSlot] = pending;
+        config.store(&slots[nextSlot], std::memory_order_release);
+        grace.synchronize();
+        nextSlot = (nextSlot + 1) % BRIDGE_CORE_CONFIG_SLOTS;
+    }
+
+    static void reset(margin_t& m) {
+        m.minimum.store(std::numeric_limits<int64_t>::max());
+        m.sum.store(0);
+        m.cycles.store(0);
+    }
+
+    // Margins beyond the ring come from a daemon that isn't running or
+    // jumped (freewheel, restart) and are left out
+    static void measure(margin_t& m, int64_t margin, uint32_t ringFrames) {
+        if ((margin <= -static_cast<int64_t>(ringFrames)) || (margin >= static_cast<int64_t>(ringFrames))) {
+            return;
+        }
+        int64_t minimum = m.minimum.load(std::memory_order_relaxed);
+        while ((margin < minimum) && !m.minimum.compare_exchange_weak(minimum, margin, std::memory_order_relaxed)) {
+        }
+        m.sum.fetch_add(margin, std::memory_order_relaxed);
+        m.cycles.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static bool update_latency(margin_t& m, uint32_t ringFrames, const latency_t& applied, latency_t& io) {
+        uint32_t cycles = m.cycles.exchange(0);
+        int64_t sum = m.sum.exchange(0);
+        int64_t minimum = m.minimum.exchange(std::numeric_limits<int64_t>::max());
+        if ((cycles == 0) || (minimum == std::numeric_limits<int64_t>::max())) {
+            return false;
+        }
+        latency_t old = io;
+
+        int64_t needed = static_cast<int64_t>(applied.safetyOffset) - minimum + BRIDGE_CORE_SAFETY_FRAMES;
+        int64_t offset = (needed >= static_cast<int64_t>(io.safetyOffset)) ? needed : io.safetyOffset - (io.safetyOffset - needed) / 4;
+        io.safetyOffset = static_cast<uint32_t>(clamp(offset, 0, ringFrames / 2));
+
+        int64_t spare = sum / static_cast<int64_t>(cycles) - static_cast<int64_t>(applied.safetyOffset);
+        int64_t latency = static_cast<int64_t>(io.latency) + (clamp(spare, 0, ringFrames) - static_cast<int64_t>(io.latency)) / 8;
+        io.latency = static_cast<uint32_t>(clamp(latency, 0, ringFrames));
+
+        return (io.safetyOffset != old.safetyOffset) || (io.latency != old.latency);
+    }
+
+    static int64_t clamp(int64_t v, int64_t lo, int64_t hi) {
+        return (v < lo) ? lo : (v > hi) ? hi : v;
+    }
+
+    // gain of the first frame and per frame step to move from level to
+    // the requested gain over nframes
+    static void ramp(float& level, const std::atomic<float>& target, uint32_t nframes, float& outGain, float& outStep) {
+        float to = target.load(std::memory_order_relaxed);
+        outGain = level;
+        outStep = (to != level) ? (to - level) / nframes : 0.0f;
+        level = to;
+    }
+
+    // Copies frames scaled by gain + step*i. The constant gain loop works on
+    // groups of 4 samples that the compiler turns into SIMD multiplies
+    // (SSE/NEON) even without loop vectorization enabled.
+    static void copy_frames(sample_t* __restrict dst, const sample_t* __restrict src, uint32_t frames, uint32_t channels, float gain, float step) {
+        if (step == 0.0f) {
+            if (gain == 1.0f) {
+                memcpy(dst, src, frames*channels*sizeof(sample_t));
+                return;
+            }
+            uint32_t n = frames*channels;
+            uint32_t i = 0;
+            for (; i+4 <= n; i+=4) {
+                dst[i]   = src[i]   * gain;
+                dst[i+1] = src[i+1] * gain;
+                dst[i+2] = src[i+2] * gain;
+                dst[i+3] = src[i+3] * gain;
+            }
+            for (; i<n; i++) {
+                dst[i] = src[i] * gain;
+            }
+            return;
+        }
+        for (uint32_t i=0; i<frames; i++) {
+            float g = gain + step*i;
+            for (uint32_t k=0; k<channels; k++) {
+                dst[i*channels + k] = src[i*channels + k] * g;
+            }
+        }
+    }
+
+    // frames to copy before the ring wraps
+    static uint32_t split(uint32_t offset, uint32_t nframes, uint32_t ringFrames) {
+        return ((offset + nframes) > ringFrames) ? (ringFrames - offset) : nframes;
+    }
+};
@@ -0,0 +1,75 @@
+/*
+ File: GracePeriod.h
+
+ MIT License
+
+ Copyright (c) 2018 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+/******************************************************************************
+ Grace periods for read-mostly data published with an atomic pointer
+
+ Readers bracket their accesses with enter()/leave() and never block. A
+ writer that has swapped the pointer calls synchronize() before freeing
+ what the old pointer referred to: it flips the epoch and waits until the
+ readers counted in the previous epoch have left. Readers entering after
+ the flip load the new pointer. Writers are serialized by the caller and
+ must not be inside enter()/leave() themselves.
+******************************************************************************/
+class GracePeriod {
+public:
+    GracePeriod() : epoch(0) {
+        readers[0].store(0);
+        readers[1].store(0);
+    }
+
+    // The count is only kept if the epoch didn't change in between, so a
+    // reader counted in the parity of an epoch entered during that epoch.
+    int enter() const {
+        while (true) {
+            uint32_t e = epoch.load();
+            readers[e & 1].fetch_add(1);
+            if (epoch.load() == e) {
+                return e & 1;
+            }
+            readers[e & 1].fetch_sub(1);
+        }
+    }
+
+    void leave(int r) const {
+        readers[r].fetch_sub(1);
+    }
+
+    void synchronize() {
+        uint32_t e = epoch.fetch_add(1);
+        while (readers[e & 1].load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::atomic<uint32_t>       epoch;
+    mutable std::atomic<int>    readers[2];     // readers in progress per epoch parity
+};
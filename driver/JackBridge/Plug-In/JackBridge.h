@@ -26,6 +26,7 @@
 #pragma once
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
 #include <string>
 #include <sstream>
@@ -40,7 +41,7 @@
 /******************************************************************************
  Audio functions (Generic/CoreAudio)
 ******************************************************************************/
-// Shared memory map: (mapped every 1MB boundary for each instance)
+// Shared memory map: (mapped every REGSMAP_SIZE boundary for each instance)
 // 0x0000      : Control Registers (Read/Write Pointers)
 // 0x0000      :    upstream write pointer
 // 0x0002      :    upstream read  pointer
@@ -53,14 +54,23 @@
 // 0x0118      :    SyncMode
 // 0x0120      :    RingBufferSize
 // 0x0128      :    Driver status
+// 0x0130      :    Timebase (host clock or frame driven virtual clock)
+// 0x0138      :    Channels per frame of every ring (0 means 2)
+// 0x0140      :    Jack period in frames (written by the daemon)
+// 0x0148      :    Time stamp period in frames (written by the driver, 0 means the ring size)
+// 0x0150      :    Frame number of the daemon after its last cycle (written by the daemon)
+// 0x0158      :    Sample rate of the rings (written by the driver, 0 means 48000)
+// 0x0160      :    Sample rate of Jack (written by the daemon, 0 means unknown)
 // 0x0180      :    Current Frame Number(coreAudio read)
 // 0x0188      :    Current Frame Number(coreAudio write)
 // 0x0190      :    Current Frame Number(coreAudio read)
 // 0x0198      :    Current Frame Number(coreAudio write)
+// 0x0200      :    Number of devices (instance #0 only, written by the daemon, 0 means 1)
+// 0x0208      :    Channels per frame of device #n at 0x0208+n*8 (instance #0 only, 0 means 2)
 // 0x10000     : Upstream buffer #0 (Driver -> Application)
-// 0x18000     : Downstream buffer #0 (Application -> Driver)
-// 0x20000     : Upstream buffer #0 (Driver -> Application)
-// 0x28000     : Downstream buffer #0 (Application -> Driver)
+// 0x30000     : Downstream buffer #0 (Application -> Driver)
+// 0x50000     : Upstream buffer #1 (Driver -> Application)
+// 0x70000     : Downstream buffer #1 (Application -> Driver)
 
 typedef float sample_t;
 #define AUDIO_SAMPLE_SIZE (sizeof(sample_t))
@@ -68,16 +78,29 @@ typedef float sample_t;
 #define NUM_OUTPUT_STREAMS  2
 #define MAX_STREAMS         2
 #define MAX_CHANNELS        ((MAX_STREAMS)*2)
-#define NUM_INSTANCES       1
+#define MAX_INSTANCES       8
 
-#define STRBUFSZ            (0x8000) // 32KB Ring buffer
-#define STRBUFNUM           (STRBUFSZ/AUDIO_SAMPLE_SIZE) // 1024 entries
-#define REGSMAP_SIZE        (0x10000*(MAX_STREAMS)+0x10000)
+#define STRBUFSZ            (0x20000) // 128KB Ring buffer (the one of 176.4/192kHz)
+#define STRBUFNUM           (STRBUFSZ/AUDIO_SAMPLE_SIZE) // 32768 entries
+#define JB_DEFAULT_CHANNELS 2
+#define JB_MAX_CHANNELS     8   // per stream
+#define JB_DEFAULT_SAMPLE_RATE 48000
+// ring size in frames, kept a power of two so that Jack periods divide it
+// (3 channels use the 4 channel layout). Rings use 32KB up to 48kHz and
+// grow with the sample rate, so they hold the same time at every rate.
+#define JB_RATE_FACTOR(rate) (((rate) <= 48000) ? 1 : ((rate) <= 96000) ? 2 : 4)
+#define JB_RING_FRAMES(ch, rate) ((STRBUFNUM/4*JB_RATE_FACTOR(rate))/(((ch) <= 1) ? 1 : ((ch) <= 2) ? 2 : ((ch) <= 4) ? 4 : 8))
+// zero time stamps come every so many Jack periods, at least this many frames apart
+#define JB_MIN_STAMP_PERIOD 256
+// IO buffer sizes CoreAudio clients may choose, the largest one is half the ring
+#define JB_MIN_IO_FRAMES    32
+#define JB_MAX_IO_FRAMES(ringFrames) ((ringFrames)/2)
+#define REGSMAP_SIZE        (STRBUFSZ*2*(MAX_STREAMS)+0x10000)
 #define REGSMAP_BOUNDARY    REGSMAP_SIZE
-#define JACK_SHMSIZE        (REGSMAP_SIZE*NUM_INSTANCES)
+#define JACK_SHMSIZE        (REGSMAP_SIZE*MAX_INSTANCES)
 #define STRBUF_U0           (0x10000)
-#define STRBUF_UP(i)        (0x10000*(i)+0x10000)
-#define STRBUF_DOWN(i)      (0x10000*(i)+0x18000)
+#define STRBUF_UP(i)        (STRBUFSZ*2*(i)+0x10000)
+#define STRBUF_DOWN(i)      (STRBUFSZ*2*(i)+STRBUFSZ+0x10000)
 
 #define JACK_SHMPATH        "/JackBridge"
 
@@ -104,6 +127,17 @@ protected:
 #define JB_DRV_STATUS_INIT      0
 #define JB_DRV_STATUS_ACTIVE    1
 #define JB_DRV_STATUS_STARTED   2
+    volatile uint64_t     *shmTimebase;
+#define JB_TIMEBASE_HOST        0   // ZeroHostTime follows mach_absolute_time()
+#define JB_TIMEBASE_VIRTUAL     1   // ZeroHostTime advances by frames (freewheel)
+    volatile uint64_t     *shmChannels;
+    volatile uint64_t     *shmJackPeriod;
+    volatile uint64_t     *shmStampPeriod;
+    volatile uint64_t     *shmDaemonFrame;
+    volatile uint64_t     *shmSampleRate;
+    volatile uint64_t     *shmJackSampleRate;
+    volatile uint64_t     *shmNumDevices;       // registers of instance #0 only
+    volatile uint64_t     *shmDeviceChannels;
     volatile uint64_t     *shmReadFrameNumber[MAX_STREAMS];
     volatile uint64_t     *shmWriteFrameNumber[MAX_STREAMS];
 
@@ -173,6 +207,15 @@ protected:
         shmSyncMode = (uint64_t*)(shm_base+0x118);
         shmBufferSize = (uint64_t*)(shm_base+0x120);
         shmDriverStatus = (uint64_t*)(shm_base+0x128);
+        shmTimebase = (uint64_t*)(shm_base+0x130);
+        shmChannels = (uint64_t*)(shm_base+0x138);
+        shmJackPeriod = (uint64_t*)(shm_base+0x140);
+        shmStampPeriod = (uint64_t*)(shm_base+0x148);
+        shmDaemonFrame = (uint64_t*)(shm_base+0x150);
+        shmSampleRate = (uint64_t*)(shm_base+0x158);
+        shmJackSampleRate = (uint64_t*)(shm_base+0x160);
+        shmNumDevices = (uint64_t*)(shm_base+0x200);
+        shmDeviceChannels = (uint64_t*)(shm_base+0x208);
 
         for(int i=0; i<MAX_STREAMS; i++) {
             buf_up[i]   = (sample_t*)(shm_base + STRBUF_UP(i));
@@ -184,10 +227,66 @@ protected:
         return 0;
     }
     
+    // channels per frame of the rings as set by the driver
+    uint32_t shm_channels() const {
+        uint64_t ch = *shmChannels;
+        return ((ch == 0) || (ch > JB_MAX_CHANNELS)) ? JB_DEFAULT_CHANNELS : (uint32_t)ch;
+    }
+
+    // sample rate of the rings as set by the driver
+    uint32_t shm_sample_rate() const {
+        uint64_t rate = *shmSampleRate;
+        return (rate == 0) ? JB_DEFAULT_SAMPLE_RATE : (uint32_t)rate;
+    }
+
+    // sample rate of Jack as told by the daemon, 0 if it didn't
+    uint32_t shm_jack_sample_rate() const {
+        return (uint32_t)*shmJackSampleRate;
+    }
+
+    // frames per ring of the layout set by the driver
+    uint32_t shm_ring_frames() const {
+        return JB_RING_FRAMES(shm_channels(), shm_sample_rate());
+    }
+
+    // frames between zero time stamps as set by the driver
+    uint32_t shm_stamp_period(uint32_t ringFrames) const {
+        uint64_t period = *shmStampPeriod;
+        return ((period == 0) || (period > ringFrames)) ? ringFrames : (uint32_t)period;
+    }
+
+    // The smallest multiple of the Jack period of at least JB_MIN_STAMP_PERIOD
+    // frames, one per ring if the daemon didn't tell its period
+    static uint32_t stamp_period(uint64_t jackPeriod, uint32_t ringFrames) {
+        if ((jackPeriod == 0) || (jackPeriod >= ringFrames)) {
+            return ringFrames;
+        }
+        uint64_t period = ((JB_MIN_STAMP_PERIOD + jackPeriod - 1) / jackPeriod) * jackPeriod;
+        return (period > ringFrames) ? ringFrames : (uint32_t)period;
+    }
+
 public:
     JackBridgeDriverIF(uint32_t _instance) : instance(_instance) {
     }
 
+    // Devices announced by the daemon, read through instance #0
+    uint32_t num_devices() const {
+        uint64_t n = *shmNumDevices;
+        return ((n == 0) || (n > MAX_INSTANCES)) ? 1 : (uint32_t)n;
+    }
+
+    uint32_t device_channels(uint32_t dev) const {
+        uint64_t ch = shmDeviceChannels[dev];
+        return ((ch == 0) || (ch > JB_MAX_CHANNELS)) ? JB_DEFAULT_CHANNELS : (uint32_t)ch;
+    }
+
+    void set_devices(uint32_t n, uint32_t channels) {
+        for (uint32_t i=0; i<n; i++) {
+            shmDeviceChannels[i] = channels;
+        }
+        *shmNumDevices = n;
+    }
+
     ~JackBridgeDriverIF() {
     }
 };
@@ -64,34 +64,66 @@
 #include "CAException.h"
 
 #include <mach/mach_time.h>
+#include <math.h>
+#include <algorithm>
 
 //==================================================================================================
 //	SA_Device
 //==================================================================================================
 #pragma mark Construction/Destruction
 
-SA_Device::SA_Device(AudioObjectID inObjectID, UInt32 instance)
+SA_Device::SA_Device(AudioObjectID inObjectID, UInt32 instance, UInt32 inChannelsPerFrame)
 :
 	SA_Object(inObjectID, kAudioDeviceClassID, kAudioObjectClassID, kAudioObjectPlugInObject),
     JackBridgeDriverIF(instance),
 	mStateMutex("Device State"),
-	mIOMutex("Device IO"),
 	mStartCount(0),
 	mSampleRateShadow(48000),
 	mRingBufferFrameSize(0),
+	mZeroTimeStampPeriod(0),
+	mDeviceLatency(0),
+	mLatencyChangePending(false),
+	mRateChangePending(false),
+	mLatencyHoldOff(0),
+	mChannelsPerFrame(inChannelsPerFrame),
 	mDriverStatus(JB_DRV_STATUS_INIT)
 {
-	for(int i=0; i<kNumberOfInputSubObjects; i++)
+	mInputLatency.safetyOffset = mInputLatency.latency = 0;
+	mOutputLatency.safetyOffset = mOutputLatency.latency = 0;
+	mMeasuredInputLatency = mInputLatency;
+	mMeasuredOutputLatency = mOutputLatency;
+	
+	for(int i=0; i<kNumberOfInputStreams; i++)
     {
 	    mInputStreamObjectID[i] = SA_ObjectMap::GetNextObjectID();
 	    mInputStreamIsActive[i] = true;
     }
 
-	for(int i=0; i<kNumberOfOutputSubObjects; i++)
+	for(int i=0; i<kNumberOfOutputStreams; i++)
     {
 	    mOutputStreamObjectID[i] = SA_ObjectMap::GetNextObjectID();
 	    mOutputStreamIsActive[i] = true;
     }
+
+	//	every stream has a volume and a mute control, starting at 0dB unmuted
+	for(int i=0; i<kNumberOfInputStreams; i++)
+    {
+	    mInputVolumeControlObjectID[i] = SA_ObjectMap::GetNextObjectID();
+	    mInputMuteControlObjectID[i] = SA_ObjectMap::GetNextObjectID();
+	    mInputVolumeRawValue[i] = kVolumeMaxRawValue;
+	    mInputMuteValue[i] = false;
+    }
+
+	for(int i=0; i<kNumberOfOutputStreams; i++)
+    {
+	    mOutputVolumeControlObjectID[i] = SA_ObjectMap::GetNextObjectID();
+	    mOutputMuteControlObjectID[i] = SA_ObjectMap::GetNextObjectID();
+	    mOutputVolumeRawValue[i] = kVolumeMaxRawValue;
+	    mOutputMuteValue[i] = false;
+    }
+
+	//	setup the volume curve with the one range
+	mVolumeCurve.AddRange(kVolumeMinRawValue, kVolumeMaxRawValue, kVolumeMinDBValue, kVolumeMaxDBValue);
 }
 
 void	SA_Device::Activate()
@@ -100,48 +132,63 @@ void	SA_Device::Activate()
 	_HW_Open();
 
 	//	map the subobject IDs to this object
-	for(int i=0; i<kNumberOfInputSubObjects; i++)
+	for(int i=0; i<kNumberOfInputStreams; i++)
     {
 	    SA_ObjectMap::MapObject(mInputStreamObjectID[i], this);
     }
 
-	for(int i=0; i<kNumberOfOutputSubObjects; i++)
+	for(int i=0; i<kNumberOfOutputStreams; i++)
     {
 	    SA_ObjectMap::MapObject(mOutputStreamObjectID[i], this);
     }
+
+	for(int i=0; i<kNumberOfInputStreams; i++)
+    {
+	    SA_ObjectMap::MapObject(mInputVolumeControlObjectID[i], this);
+	    SA_ObjectMap::MapObject(mInputMuteControlObjectID[i], this);
+    }
+
+	for(int i=0; i<kNumberOfOutputStreams; i++)
+    {
+	    SA_ObjectMap::MapObject(mOutputVolumeControlObjectID[i], this);
+	    SA_ObjectMap::MapObject(mOutputMuteControlObjectID[i], this);
+    }
 	
 	//	call the super-class, which just marks the object as active
 	SA_Object::Activate();
-
-    //  calculate the host ticks per frame
-    struct mach_timebase_info theTimeBaseInfo;
-    mach_timebase_info(&theTimeBaseInfo);
-    Float64 theHostClockFrequency = theTimeBaseInfo.denom / theTimeBaseInfo.numer;
-    theHostClockFrequency *= 1000000000.0;
-    gDevice_HostTicksPerFrame = theHostClockFrequency / mSampleRateShadow;
 }
 
 void	SA_Device::Deactivate()
 {
 	//	When this method is called, the obejct is basically dead, but we still need to be thread
-	//	safe. In this case, we also need to be safe vs. any IO threads, so we need to take both
-	//	locks.
+	//	safe. The IO path takes no lock (see BridgeDeviceCore), so the state lock is enough.
 	CAMutex::Locker theStateLocker(mStateMutex);
-	CAMutex::Locker theIOLocker(mIOMutex);
 	
 	//	mark the object inactive by calling the super-class
 	SA_Object::Deactivate();
 	
 	//	unmap the subobject IDs
-	for(int i=0; i<kNumberOfInputSubObjects; i++)
+	for(int i=0; i<kNumberOfInputStreams; i++)
     {
 	    SA_ObjectMap::UnmapObject(mInputStreamObjectID[i], this);
     }
 
-	for(int i=0; i<kNumberOfOutputSubObjects; i++)
+	for(int i=0; i<kNumberOfOutputStreams; i++)
     {
 	    SA_ObjectMap::UnmapObject(mOutputStreamObjectID[i], this);
     }
+
+	for(int i=0; i<kNumberOfInputStreams; i++)
+    {
+	    SA_ObjectMap::UnmapObject(mInputVolumeControlObjectID[i], this);
+	    SA_ObjectMap::UnmapObject(mInputMuteControlObjectID[i], this);
+    }
+
+	for(int i=0; i<kNumberOfOutputStreams; i++)
+    {
+	    SA_ObjectMap::UnmapObject(mOutputVolumeControlObjectID[i], this);
+	    SA_ObjectMap::UnmapObject(mOutputMuteControlObjectID[i], this);
+    }
 	
 	//	close the connection to the driver
 	_HW_Close();
@@ -153,13 +200,13 @@ SA_Device::~SA_Device()
 
 bool	SA_Device::IsStreamObjectID(AudioObjectID inObjectID) const
 {
-	for(int i=0; i<kNumberOfInputSubObjects; i++)
+	for(int i=0; i<kNumberOfInputStreams; i++)
     {
         if (inObjectID == mInputStreamObjectID[i])
             return true;
     }
 
-	for(int i=0; i<kNumberOfOutputSubObjects; i++)
+	for(int i=0; i<kNumberOfOutputStreams; i++)
     {
         if (inObjectID == mOutputStreamObjectID[i])
             return true;
@@ -169,7 +216,7 @@ bool	SA_Device::IsStreamObjectID(AudioObjectID inObjectID) const
 
 bool 	SA_Device::IsInputStreamID(AudioObjectID inObjectID) const
 {
-	for(int i=0; i<kNumberOfInputSubObjects; i++)
+	for(int i=0; i<kNumberOfInputStreams; i++)
     {
         if (inObjectID == mInputStreamObjectID[i])
             return true;
@@ -179,12 +226,12 @@ bool 	SA_Device::IsInputStreamID(AudioObjectID inObjectID) const
 
 int 	SA_Device::getStreamID(AudioObjectID inObjectID) const
 {
-	for(int i=0; i<kNumberOfInputSubObjects; i++)
+	for(int i=0; i<kNumberOfInputStreams; i++)
     {
         if (inObjectID == mInputStreamObjectID[i])
             return i;
     }
-	for(int i=0; i<kNumberOfOutputSubObjects; i++)
+	for(int i=0; i<kNumberOfOutputStreams; i++)
     {
         if (inObjectID == mOutputStreamObjectID[i])
             return i;
@@ -192,6 +239,79 @@ int 	SA_Device::getStreamID(AudioObjectID inObjectID) const
     return 0;
 }
 
+bool	SA_Device::IsControlObjectID(AudioObjectID inObjectID) const
+{
+    bool theIsInput, theIsMute;
+    int theStreamId;
+    return FindControl(inObjectID, theIsInput, theIsMute, theStreamId);
+}
+
+bool	SA_Device::FindControl(AudioObjectID inObjectID, bool& outIsInput, bool& outIsMute, int& outStreamId) const
+{
+	for(int i=0; i<kNumberOfInputStreams; i++)
+    {
+        if ((inObjectID == mInputVolumeControlObjectID[i]) || (inObjectID == mInputMuteControlObjectID[i]))
+        {
+            outIsInput = true;
+            outIsMute = (inObjectID == mInputMuteControlObjectID[i]);
+            outStreamId = i;
+            return true;
+        }
+    }
+	for(int i=0; i<kNumberOfOutputStreams; i++)
+    {
+        if ((inObjectID == mOutputVolumeControlObjectID[i]) || (inObjectID == mOutputMuteControlObjectID[i]))
+        {
+            outIsInput = false;
+            outIsMute = (inObjectID == mOutputMuteControlObjectID[i]);
+            outStreamId = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+//	Fills outIDs with the streams and/or the controls of the scope, inputs first
+UInt32	SA_Device::CopySubObjectIDs(AudioObjectPropertyScope inScope, bool inStreams, bool inControls, UInt32 inMaxItems, AudioObjectID* outIDs) const
+{
+    bool theInput = (inScope == kAudioObjectPropertyScopeGlobal) || (inScope == kAudioObjectPropertyScopeInput);
+    bool theOutput = (inScope == kAudioObjectPropertyScopeGlobal) || (inScope == kAudioObjectPropertyScopeOutput);
+    AudioObjectID theIDs[kNumberOfSubObjects];
+    UInt32 theNumberIDs = 0;
+
+    if (inStreams)
+    {
+        for(int i=0; theInput && (i<kNumberOfInputStreams); i++)
+        {
+            theIDs[theNumberIDs++] = mInputStreamObjectID[i];
+        }
+        for(int i=0; theOutput && (i<kNumberOfOutputStreams); i++)
+        {
+            theIDs[theNumberIDs++] = mOutputStreamObjectID[i];
+        }
+    }
+    if (inControls)
+    {
+        for(int i=0; theInput && (i<kNumberOfInputStreams); i++)
+        {
+            theIDs[theNumberIDs++] = mInputVolumeControlObjectID[i];
+            theIDs[theNumberIDs++] = mInputMuteControlObjectID[i];
+        }
+        for(int i=0; theOutput && (i<kNumberOfOutputStreams); i++)
+        {
+            theIDs[theNumberIDs++] = mOutputVolumeControlObjectID[i];
+            theIDs[theNumberIDs++] = mOutputMuteControlObjectID[i];
+        }
+    }
+
+    if (theNumberIDs > inMaxItems)
+    {
+        theNumberIDs = inMaxItems;
+    }
+    memcpy(outIDs, theIDs, theNumberIDs * sizeof(AudioObjectID));
+    return theNumberIDs;
+}
+
 #pragma mark Property Operations
 bool	SA_Device::HasProperty(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress) const
 {
@@ -207,6 +327,10 @@ bool	SA_Device::HasProperty(AudioObjectID inObjectID, pid_t inClientPID, const A
 	{
 		theAnswer = Stream_HasProperty(inObjectID, inClientPID, inAddress);
 	}
+	else if(IsControlObjectID(inObjectID))
+	{
+		theAnswer = Control_HasProperty(inObjectID, inClientPID, inAddress);
+	}
 	else
 	{
 		Throw(CAException(kAudioHardwareBadObjectError));
@@ -225,6 +349,10 @@ bool	SA_Device::IsPropertySettable(AudioObjectID inObjectID, pid_t inClientPID,
 	{
 		theAnswer = Stream_IsPropertySettable(inObjectID, inClientPID, inAddress);
 	}
+	else if(IsControlObjectID(inObjectID))
+	{
+		theAnswer = Control_IsPropertySettable(inObjectID, inClientPID, inAddress);
+	}
 	else
 	{
 		Throw(CAException(kAudioHardwareBadObjectError));
@@ -243,6 +371,10 @@ UInt32	SA_Device::GetPropertyDataSize(AudioObjectID inObjectID, pid_t inClientPI
 	{
 		theAnswer = Stream_GetPropertyDataSize(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData);
 	}
+	else if(IsControlObjectID(inObjectID))
+	{
+		theAnswer = Control_GetPropertyDataSize(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData);
+	}
 	else
 	{
 		Throw(CAException(kAudioHardwareBadObjectError));
@@ -261,6 +393,10 @@ void	SA_Device::GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, con
 	{
 		Stream_GetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, outDataSize, outData);
 	}
+	else if(IsControlObjectID(inObjectID))
+	{
+		Control_GetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, outDataSize, outData);
+	}
 	else
 	{
 		Throw(CAException(kAudioHardwareBadObjectError));
@@ -277,6 +413,10 @@ void	SA_Device::SetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, con
 	{
 		Stream_SetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, inData);
 	}
+	else if(IsControlObjectID(inObjectID))
+	{
+		Control_SetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, inData);
+	}
 	else
 	{
 		Throw(CAException(kAudioHardwareBadObjectError));
@@ -308,6 +448,7 @@ bool	SA_Device::Device_HasProperty(AudioObjectID inObjectID, pid_t inClientPID,
 		case kAudioDevicePropertyAvailableNominalSampleRates:
 		case kAudioDevicePropertyIsHidden:
 		case kAudioDevicePropertyZeroTimeStampPeriod:
+		case kAudioDevicePropertyBufferFrameSizeRange:
 		case kAudioDevicePropertyStreams:
 			theAnswer = true;
 			break;
@@ -357,6 +498,7 @@ bool	SA_Device::Device_IsPropertySettable(AudioObjectID inObjectID, pid_t inClie
 		case kAudioDevicePropertyPreferredChannelsForStereo:
 		case kAudioDevicePropertyPreferredChannelLayout:
 		case kAudioDevicePropertyZeroTimeStampPeriod:
+		case kAudioDevicePropertyBufferFrameSizeRange:
 			theAnswer = false;
 			break;
 		
@@ -475,7 +617,7 @@ UInt32	SA_Device::Device_GetPropertyDataSize(AudioObjectID inObjectID, pid_t inC
 			break;
 
 		case kAudioDevicePropertyAvailableNominalSampleRates:
-			theAnswer = 2 * sizeof(AudioValueRange);
+			theAnswer = kNumberOfSampleRates * sizeof(AudioValueRange);
 			break;
 		
 		case kAudioDevicePropertyIsHidden:
@@ -487,13 +629,17 @@ UInt32	SA_Device::Device_GetPropertyDataSize(AudioObjectID inObjectID, pid_t inC
 			break;
 
 		case kAudioDevicePropertyPreferredChannelLayout:
-			theAnswer = offsetof(AudioChannelLayout, mChannelDescriptions) + (2 * sizeof(AudioChannelDescription));
+			theAnswer = offsetof(AudioChannelLayout, mChannelDescriptions) + (mChannelsPerFrame * sizeof(AudioChannelDescription));
 			break;
 
 		case kAudioDevicePropertyZeroTimeStampPeriod:
 			theAnswer = sizeof(UInt32);
 			break;
 
+		case kAudioDevicePropertyBufferFrameSizeRange:
+			theAnswer = sizeof(AudioValueRange);
+			break;
+
 		default:
 			theAnswer = SA_Object::GetPropertyDataSize(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData);
 			break;
@@ -517,7 +663,7 @@ void	SA_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			//	value that is a key into the localizable strings in this bundle. This allows us to
 			//	return a localized name for the device.
 			ThrowIf(inDataSize < sizeof(AudioObjectID), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Device_GetPropertyData: not enough space for the return value of kAudioObjectPropertyManufacturer for the device");
-            *reinterpret_cast<CFStringRef*>(outData) = CFSTR("DeviceName");
+            *reinterpret_cast<CFStringRef*>(outData) = CopyDeviceName();
 			outDataSize = sizeof(CFStringRef);
 			break;
 			
@@ -538,63 +684,7 @@ void	SA_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			
 			//	The device owns its streams and controls. Note that what is returned here
 			//	depends on the scope requested.
-			switch(inAddress.mScope)
-			{
-				case kAudioObjectPropertyScopeGlobal:
-					//	global scope means return all objects
-					if(theNumberItemsToFetch > kNumberOfSubObjects)
-					{
-						theNumberItemsToFetch = kNumberOfSubObjects;
-					}
-					
-					//	fill out the list with as many objects as requested, which is everything
-                    for (int i=0; i<theNumberItemsToFetch; i++)
-                    {
-					    if(i < kNumberOfInputSubObjects)
-                        {
-						    reinterpret_cast<AudioObjectID*>(outData)[i] = mInputStreamObjectID[i];
-					    }
-                        else if(i < kNumberOfSubObjects)
-                        { 
-						    reinterpret_cast<AudioObjectID*>(outData)[i] = mOutputStreamObjectID[i-kNumberOfInputSubObjects];
-                        }
-                    }
-					break;
-					
-				case kAudioObjectPropertyScopeInput:
-					//	input scope means just the objects on the input side
-					if(theNumberItemsToFetch > kNumberOfInputSubObjects)
-					{
-						theNumberItemsToFetch = kNumberOfInputSubObjects;
-					}
-					
-					//	fill out the list with the right objects
-                    for (int i=0; i<theNumberItemsToFetch; i++)
-                    {
-					    if(i < kNumberOfInputSubObjects)
-                        {
-						    reinterpret_cast<AudioObjectID*>(outData)[i] = mInputStreamObjectID[i];
-					    }
-                    }
-					break;
-					
-				case kAudioObjectPropertyScopeOutput:
-					//	output scope means just the objects on the output side
-					if(theNumberItemsToFetch > kNumberOfOutputSubObjects)
-					{
-						theNumberItemsToFetch = kNumberOfOutputSubObjects;
-					}
-					
-					//	fill out the list with the right objects
-                    for (int i=0; i<theNumberItemsToFetch; i++)
-                    {
-					    if(i < kNumberOfOutputSubObjects)
-                        {
-						    reinterpret_cast<AudioObjectID*>(outData)[i] = mOutputStreamObjectID[i];
-					    }
-                    }
-					break;
-			};
+			theNumberItemsToFetch = CopySubObjectIDs(inAddress.mScope, true, true, theNumberItemsToFetch, reinterpret_cast<AudioObjectID*>(outData));
 			
 			//	report how much we wrote
 			outDataSize = theNumberItemsToFetch * sizeof(AudioObjectID);
@@ -605,7 +695,7 @@ void	SA_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			//	audio device across boot sessions. Note that two instances of the same
 			//	device must have different values for this property.
 			ThrowIf(inDataSize < sizeof(AudioObjectID), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyDeviceUID for the device");
-			*reinterpret_cast<CFStringRef*>(outData) = CFSTR(kDeviceUID);
+			*reinterpret_cast<CFStringRef*>(outData) = CopyDeviceUID();
 			outDataSize = sizeof(CFStringRef);
 			break;
 
@@ -713,10 +803,10 @@ void	SA_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			break;
 
 		case kAudioDevicePropertyLatency:
-			//	This property returns the presentation latency of the device. For this,
-			//	device, the value is 0 due to the fact that it always vends silence.
+			//	This property returns the presentation latency of the device. For this
+			//	device, it is the Jack period the daemon buffers in either direction.
 			ThrowIf(inDataSize < sizeof(UInt32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyLatency for the device");
-			*reinterpret_cast<UInt32*>(outData) = 0;
+			*reinterpret_cast<UInt32*>(outData) = mDeviceLatency;
 			outDataSize = sizeof(UInt32);
 			break;
 
@@ -793,27 +883,27 @@ void	SA_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			//	Calculate the number of items that have been requested. Note that this
 			//	number is allowed to be smaller than the actual size of the list. In such
 			//	case, only that number of items will be returned
-			outDataSize = 0;
+			theNumberItemsToFetch = inDataSize / sizeof(AudioObjectID);
+			
+			//	the list has all the controls whatever the scope
+			theNumberItemsToFetch = CopySubObjectIDs(kAudioObjectPropertyScopeGlobal, false, true, theNumberItemsToFetch, reinterpret_cast<AudioObjectID*>(outData));
+			outDataSize = theNumberItemsToFetch * sizeof(AudioObjectID);
 			break;
 
 		case kAudioDevicePropertySafetyOffset:
 			//	This property returns the how close to now the HAL can read and write. For
-			//	this, device, the value is 0 due to the fact that it always vends silence.
+			//	this device, it is measured against the daemon's position, see UpdateLatency().
 			ThrowIf(inDataSize < sizeof(UInt32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertySafetyOffset for the device");
-			*reinterpret_cast<UInt32*>(outData) = 0;
+			*reinterpret_cast<UInt32*>(outData) = (inAddress.mScope == kAudioObjectPropertyScopeInput) ? mInputLatency.safetyOffset : mOutputLatency.safetyOffset;
 			outDataSize = sizeof(UInt32);
 			break;
 
 		case kAudioDevicePropertyNominalSampleRate:
-			//	This property returns the nominal sample rate of the device. Note that we
-			//	only need to take the state lock to get this value.
+			//	This property returns the nominal sample rate of the device. The host polls it,
+			//	so it is read from the atomic shadow without taking the state lock.
 			{
 				ThrowIf(inDataSize < sizeof(Float64), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyNominalSampleRate for the device");
 			
-				//	The sample rate is protected by the state lock
-				CAMutex::Locker theStateLocker(mStateMutex);
-					
-				//	need to lock around fetching the sample rate
 				*reinterpret_cast<Float64*>(outData) = static_cast<Float64>(_HW_GetSampleRate());
 				outDataSize = sizeof(Float64);
 			}
@@ -830,21 +920,16 @@ void	SA_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			theNumberItemsToFetch = inDataSize / sizeof(AudioValueRange);
 			
 			//	clamp it to the number of items we have
-			if(theNumberItemsToFetch > 2)
+			if(theNumberItemsToFetch > kNumberOfSampleRates)
 			{
-				theNumberItemsToFetch = 2;
+				theNumberItemsToFetch = kNumberOfSampleRates;
 			}
 			
 			//	fill out the return array
-			if(theNumberItemsToFetch > 0)
-			{
-				((AudioValueRange*)outData)[0].mMinimum = 44100.0;
-				((AudioValueRange*)outData)[0].mMaximum = 44100.0;
-			}
-			if(theNumberItemsToFetch > 1)
+			for(UInt32 theItemIndex = 0; theItemIndex < theNumberItemsToFetch; ++theItemIndex)
 			{
-				((AudioValueRange*)outData)[1].mMinimum = 48000.0;
-				((AudioValueRange*)outData)[1].mMaximum = 48000.0;
+				((AudioValueRange*)outData)[theItemIndex].mMinimum = kSampleRates[theItemIndex];
+				((AudioValueRange*)outData)[theItemIndex].mMaximum = kSampleRates[theItemIndex];
 			}
 			
 			//	report how much we wrote
@@ -869,17 +954,18 @@ void	SA_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 
 		case kAudioDevicePropertyPreferredChannelLayout:
 			//	This property returns the default AudioChannelLayout to use for the device
-			//	by default. For this device, we return a stereo ACL.
+			//	by default. For this device, we return left/right followed by discrete channels.
 			{
 				//	calcualte how big the
-				UInt32 theACLSize = offsetof(AudioChannelLayout, mChannelDescriptions) + (2 * sizeof(AudioChannelDescription));
+				UInt32 theNumberChannels = mChannelsPerFrame;
+				UInt32 theACLSize = offsetof(AudioChannelLayout, mChannelDescriptions) + (theNumberChannels * sizeof(AudioChannelDescription));
 				ThrowIf(inDataSize < theACLSize, CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyPreferredChannelLayout for the device");
 				((AudioChannelLayout*)outData)->mChannelLayoutTag = kAudioChannelLayoutTag_UseChannelDescriptions;
 				((AudioChannelLayout*)outData)->mChannelBitmap = 0;
-				((AudioChannelLayout*)outData)->mNumberChannelDescriptions = 2;
-				for(theItemIndex = 0; theItemIndex < 2; ++theItemIndex)
+				((AudioChannelLayout*)outData)->mNumberChannelDescriptions = theNumberChannels;
+				for(theItemIndex = 0; theItemIndex < theNumberChannels; ++theItemIndex)
 				{
-					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mChannelLabel = kAudioChannelLabel_Left + theItemIndex;
+					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mChannelLabel = (theItemIndex < 2) ? (kAudioChannelLabel_Left + theItemIndex) : (kAudioChannelLabel_Discrete_0 + theItemIndex);
 					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mChannelFlags = 0;
 					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mCoordinates[0] = 0;
 					((AudioChannelLayout*)outData)->mChannelDescriptions[theItemIndex].mCoordinates[1] = 0;
@@ -893,10 +979,19 @@ void	SA_Device::Device_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			//	This property returns how many frames the HAL should expect to see between
 			//	successive sample times in the zero time stamps this device provides.
 			ThrowIf(inDataSize < sizeof(UInt32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyZeroTimeStampPeriod for the device");
-			*reinterpret_cast<UInt32*>(outData) = mRingBufferFrameSize;
+			*reinterpret_cast<UInt32*>(outData) = mZeroTimeStampPeriod;
 			outDataSize = sizeof(UInt32);
 			break;
 
+		case kAudioDevicePropertyBufferFrameSizeRange:
+			//	This property returns the IO buffer sizes the clients may choose from. The
+			//	largest one leaves the other half of the ring to the daemon.
+			ThrowIf(inDataSize < sizeof(AudioValueRange), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Device_GetPropertyData: not enough space for the return value of kAudioDevicePropertyBufferFrameSizeRange for the device");
+			((AudioValueRange*)outData)->mMinimum = JB_MIN_IO_FRAMES;
+			((AudioValueRange*)outData)->mMaximum = JB_MAX_IO_FRAMES(mRingBufferFrameSize);
+			outDataSize = sizeof(AudioValueRange);
+			break;
+
 		default:
 			SA_Object::GetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, outDataSize, outData);
 			break;
@@ -916,7 +1011,7 @@ void	SA_Device::Device_SetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			{
 				//	check the arguments
 				ThrowIf(inDataSize != sizeof(Float64), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Device_SetPropertyData: wrong size for the data for kAudioDevicePropertyNominalSampleRate");
-				ThrowIf((*((const Float64*)inData) != 44100.0) && (*((const Float64*)inData) != 48000.0), CAException(kAudioHardwareIllegalOperationError), "SA_Device::Device_SetPropertyData: unsupported value for kAudioDevicePropertyNominalSampleRate");
+				ThrowIf(!IsSupportedSampleRate(*((const Float64*)inData)), CAException(kAudioHardwareIllegalOperationError), "SA_Device::Device_SetPropertyData: unsupported value for kAudioDevicePropertyNominalSampleRate");
 				
 				//	we need to lock around getting the current sample rate to compare against the new rate
 				UInt64 theOldSampleRate = 0;
@@ -1041,7 +1136,7 @@ UInt32	SA_Device::Stream_GetPropertyDataSize(AudioObjectID inObjectID, pid_t inC
 
 		case kAudioStreamPropertyAvailableVirtualFormats:
 		case kAudioStreamPropertyAvailablePhysicalFormats:
-			theAnswer = 2 * sizeof(AudioStreamRangedDescription);
+			theAnswer = kNumberOfSampleRates * JB_MAX_CHANNELS * sizeof(AudioStreamRangedDescription);
 			break;
 
 		default:
@@ -1059,6 +1154,7 @@ void	SA_Device::Stream_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 	//	it is necessary to lock the state mutex.
 	
 	UInt32 theNumberItemsToFetch;
+	UInt32 theItemIndex;
 	switch(inAddress.mSelector)
 	{
 		case kAudioObjectPropertyBaseClass:
@@ -1120,16 +1216,19 @@ void	SA_Device::Stream_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			//	the stream. For exmaple, if a device has two output streams with two
 			//	channels each, then the starting channel number for the first stream is 1
 			//	and ths starting channel number fo the second stream is 3.
-			ThrowIf(inDataSize < sizeof(UInt32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Stream_GetPropertyData: not enough space for the return value of kAudioStreamPropertyStartingChannel for the stream");
-			*reinterpret_cast<UInt32*>(outData) = getStreamID(inObjectID)*2+1;
-			//*reinterpret_cast<UInt32*>(outData) = 1;
-			outDataSize = sizeof(UInt32);
+			{
+				ThrowIf(inDataSize < sizeof(UInt32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Stream_GetPropertyData: not enough space for the return value of kAudioStreamPropertyStartingChannel for the stream");
+				CAMutex::Locker theStateLocker(mStateMutex);
+				*reinterpret_cast<UInt32*>(outData) = getStreamID(inObjectID)*mChannelsPerFrame+1;
+				outDataSize = sizeof(UInt32);
+			}
 			break;
 
 		case kAudioStreamPropertyLatency:
-			//	This property returns any additonal presentation latency the stream has.
+			//	This property returns any additonal presentation latency the stream has. For
+			//	this device, it is the time the data spends in the ring beyond the safety offset.
 			ThrowIf(inDataSize < sizeof(UInt32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Stream_GetPropertyData: not enough space for the return value of kAudioStreamPropertyStartingChannel for the stream");
-			*reinterpret_cast<UInt32*>(outData) = 0;
+			*reinterpret_cast<UInt32*>(outData) = IsInputStreamID(inObjectID) ? mInputLatency.latency : mOutputLatency.latency;
 			outDataSize = sizeof(UInt32);
 			break;
 
@@ -1141,18 +1240,10 @@ void	SA_Device::Stream_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			{
 				ThrowIf(inDataSize < sizeof(AudioStreamBasicDescription), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Stream_GetPropertyData: not enough space for the return value of kAudioStreamPropertyVirtualFormat for the stream");
 				
-				//	lock the state mutex
-				CAMutex::Locker theStateLocker(mStateMutex);
-				
-				//	This particular device always vends  16 bit native endian signed integers
-				reinterpret_cast<AudioStreamBasicDescription*>(outData)->mSampleRate = static_cast<Float64>(_HW_GetSampleRate());
-				reinterpret_cast<AudioStreamBasicDescription*>(outData)->mFormatID = kAudioFormatLinearPCM;
-				reinterpret_cast<AudioStreamBasicDescription*>(outData)->mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
-				reinterpret_cast<AudioStreamBasicDescription*>(outData)->mBytesPerPacket = 8;
-				reinterpret_cast<AudioStreamBasicDescription*>(outData)->mFramesPerPacket = 1;
-				reinterpret_cast<AudioStreamBasicDescription*>(outData)->mBytesPerFrame = 8;
-				reinterpret_cast<AudioStreamBasicDescription*>(outData)->mChannelsPerFrame = 2;
-				reinterpret_cast<AudioStreamBasicDescription*>(outData)->mBitsPerChannel = 32;
+				//	This particular device always vends 32 bit native endian floats, the number
+				//	of channels is the same for all streams. Neither the sample rate nor the
+				//	channels need the state lock, both only change in a configuration change.
+				MakeStreamFormat(static_cast<Float64>(_HW_GetSampleRate()), mChannelsPerFrame, *reinterpret_cast<AudioStreamBasicDescription*>(outData));
 				outDataSize = sizeof(AudioStreamBasicDescription);
 			}
 			break;
@@ -1168,37 +1259,19 @@ void	SA_Device::Stream_GetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			theNumberItemsToFetch = inDataSize / sizeof(AudioStreamRangedDescription);
 			
 			//	clamp it to the number of items we have
-			if(theNumberItemsToFetch > 2)
+			if(theNumberItemsToFetch > kNumberOfSampleRates * JB_MAX_CHANNELS)
 			{
-				theNumberItemsToFetch = 2;
+				theNumberItemsToFetch = kNumberOfSampleRates * JB_MAX_CHANNELS;
 			}
 			
-			//	fill out the return array
-			if(theNumberItemsToFetch > 0)
-			{
-				((AudioStreamRangedDescription*)outData)[0].mFormat.mSampleRate = 44100.0;
-				((AudioStreamRangedDescription*)outData)[0].mFormat.mFormatID = kAudioFormatLinearPCM;
-				((AudioStreamRangedDescription*)outData)[0].mFormat.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
-				((AudioStreamRangedDescription*)outData)[0].mFormat.mBytesPerPacket = 8;
-				((AudioStreamRangedDescription*)outData)[0].mFormat.mFramesPerPacket = 1;
-				((AudioStreamRangedDescription*)outData)[0].mFormat.mBytesPerFrame = 8;
-				((AudioStreamRangedDescription*)outData)[0].mFormat.mChannelsPerFrame = 2;
-				((AudioStreamRangedDescription*)outData)[0].mFormat.mBitsPerChannel = 32;
-				((AudioStreamRangedDescription*)outData)[0].mSampleRateRange.mMinimum = 44100.0;
-				((AudioStreamRangedDescription*)outData)[0].mSampleRateRange.mMaximum = 44100.0;
-			}
-			if(theNumberItemsToFetch > 1)
+			//	fill out the return array, every sample rate with every channel count
+			for(theItemIndex = 0; theItemIndex < theNumberItemsToFetch; ++theItemIndex)
 			{
-				((AudioStreamRangedDescription*)outData)[1].mFormat.mSampleRate = 48000.0;
-				((AudioStreamRangedDescription*)outData)[1].mFormat.mFormatID = kAudioFormatLinearPCM;
-				((AudioStreamRangedDescription*)outData)[1].mFormat.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
-				((AudioStreamRangedDescription*)outData)[1].mFormat.mBytesPerPacket = 8;
-				((AudioStreamRangedDescription*)outData)[1].mFormat.mFramesPerPacket = 1;
-				((AudioStreamRangedDescription*)outData)[1].mFormat.mBytesPerFrame = 8;
-				((AudioStreamRangedDescription*)outData)[1].mFormat.mChannelsPerFrame = 2;
-				((AudioStreamRangedDescription*)outData)[1].mFormat.mBitsPerChannel = 32;
-				((AudioStreamRangedDescription*)outData)[1].mSampleRateRange.mMinimum = 48000.0;
-				((AudioStreamRangedDescription*)outData)[1].mSampleRateRange.mMaximum = 48000.0;
+				Float64 theSampleRate = kSampleRates[theItemIndex / JB_MAX_CHANNELS];
+				UInt32 theNumberChannels = (theItemIndex % JB_MAX_CHANNELS) + 1;
+				MakeStreamFormat(theSampleRate, theNumberChannels, ((AudioStreamRangedDescription*)outData)[theItemIndex].mFormat);
+				((AudioStreamRangedDescription*)outData)[theItemIndex].mSampleRateRange.mMinimum = theSampleRate;
+				((AudioStreamRangedDescription*)outData)[theItemIndex].mSampleRateRange.mMaximum = theSampleRate;
 			}
 			
 			//	report how much we wrote
@@ -1258,35 +1331,39 @@ void	SA_Device::Stream_SetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 			{
 				//	Changing the stream format needs to be handled via the
 				//	RequestConfigChange/PerformConfigChange machinery. Note that because this
-				//	device only supports 2 channel 32 bit float data, the only thing that can
-				//	change is the sample rate.
+				//	device only supports 32 bit float data, the only things that can change
+				//	are the sample rate and the number of channels (the same for all streams).
 				ThrowIf(inDataSize != sizeof(AudioStreamBasicDescription), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Stream_SetPropertyData: wrong size for the data for kAudioStreamPropertyPhysicalFormat");
 				
 				const AudioStreamBasicDescription* theNewFormat = reinterpret_cast<const AudioStreamBasicDescription*>(inData);
 				ThrowIf(theNewFormat->mFormatID != kAudioFormatLinearPCM, CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported format ID for kAudioStreamPropertyPhysicalFormat");
 				ThrowIf(theNewFormat->mFormatFlags != (kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked), CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported format flags for kAudioStreamPropertyPhysicalFormat");
-				ThrowIf(theNewFormat->mBytesPerPacket != 8, CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported bytes per packet for kAudioStreamPropertyPhysicalFormat");
+				ThrowIf((theNewFormat->mChannelsPerFrame < 1) || (theNewFormat->mChannelsPerFrame > JB_MAX_CHANNELS), CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported channels per frame for kAudioStreamPropertyPhysicalFormat");
+				ThrowIf(theNewFormat->mBytesPerPacket != theNewFormat->mChannelsPerFrame * sizeof(sample_t), CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported bytes per packet for kAudioStreamPropertyPhysicalFormat");
 				ThrowIf(theNewFormat->mFramesPerPacket != 1, CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported frames per packet for kAudioStreamPropertyPhysicalFormat");
-				ThrowIf(theNewFormat->mBytesPerFrame != 8, CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported bytes per frame for kAudioStreamPropertyPhysicalFormat");
-				ThrowIf(theNewFormat->mChannelsPerFrame != 2, CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported channels per frame for kAudioStreamPropertyPhysicalFormat");
+				ThrowIf(theNewFormat->mBytesPerFrame != theNewFormat->mChannelsPerFrame * sizeof(sample_t), CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported bytes per frame for kAudioStreamPropertyPhysicalFormat");
 				ThrowIf(theNewFormat->mBitsPerChannel != 32, CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported bits per channel for kAudioStreamPropertyPhysicalFormat");
-				ThrowIf((theNewFormat->mSampleRate != 44100.0) && (theNewFormat->mSampleRate != 48000.0), CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported sample rate for kAudioStreamPropertyPhysicalFormat");
+				ThrowIf(!IsSupportedSampleRate(theNewFormat->mSampleRate), CAException(kAudioDeviceUnsupportedFormatError), "SA_Device::Stream_SetPropertyData: unsupported sample rate for kAudioStreamPropertyPhysicalFormat");
 			
-				//	we need to lock around getting the current sample rate to compare against the new rate
+				//	we need to lock around getting the current format to compare against the new one
 				UInt64 theOldSampleRate = 0;
+				UInt32 theOldNumberChannels = 0;
 				{
 					CAMutex::Locker theStateLocker(mStateMutex);
 					theOldSampleRate = _HW_GetSampleRate();
+					theOldNumberChannels = mChannelsPerFrame;
 				}
 				
 				//	make sure that the new value is different than the old value
-				UInt64 theNewSampleRate = static_cast<UInt64>(*reinterpret_cast<const Float64*>(inData));
-				if(theNewSampleRate != theOldSampleRate)
+				UInt64 theNewSampleRate = static_cast<UInt64>(theNewFormat->mSampleRate);
+				UInt32 theNewNumberChannels = theNewFormat->mChannelsPerFrame;
+				if((theNewSampleRate != theOldSampleRate) || (theNewNumberChannels != theOldNumberChannels))
 				{
 					//	we dispatch this so that the change can happen asynchronously
 					AudioObjectID theDeviceObjectID = GetObjectID();
+					UInt64 theChangeAction = kConfigChangeAction(theNewSampleRate, theNewNumberChannels);
 					CADispatchQueue::GetGlobalSerialQueue().Dispatch(false,	^{
-																				SA_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, theNewSampleRate, NULL);
+																				SA_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, theChangeAction, NULL);
 																			});
 				}
 			}
@@ -1298,6 +1375,326 @@ void	SA_Device::Stream_SetPropertyData(AudioObjectID inObjectID, pid_t inClientP
 	};
 }
 
+#pragma mark Control Property Operations
+
+bool	SA_Device::Control_HasProperty(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress) const
+{
+	//	For each object, this driver implements all the required properties plus a few extras that
+	//	are useful but not required. There is more detailed commentary about each property in the
+	//	Control_GetPropertyData() method.
+	
+	bool theIsInput = false, theIsMute = false;
+	int theStreamId = 0;
+	FindControl(inObjectID, theIsInput, theIsMute, theStreamId);
+	
+	bool theAnswer = false;
+	switch(inAddress.mSelector)
+	{
+		case kAudioControlPropertyScope:
+		case kAudioControlPropertyElement:
+			theAnswer = true;
+			break;
+		
+		case kAudioLevelControlPropertyScalarValue:
+		case kAudioLevelControlPropertyDecibelValue:
+		case kAudioLevelControlPropertyDecibelRange:
+		case kAudioLevelControlPropertyConvertScalarToDecibels:
+		case kAudioLevelControlPropertyConvertDecibelsToScalar:
+			theAnswer = !theIsMute;
+			break;
+		
+		case kAudioBooleanControlPropertyValue:
+			theAnswer = theIsMute;
+			break;
+		
+		default:
+			theAnswer = SA_Object::HasProperty(inObjectID, inClientPID, inAddress);
+			break;
+	};
+	return theAnswer;
+}
+
+bool	SA_Device::Control_IsPropertySettable(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress) const
+{
+	//	For each object, this driver implements all the required properties plus a few extras that
+	//	are useful but not required. There is more detailed commentary about each property in the
+	//	Control_GetPropertyData() method.
+	
+	bool theAnswer = false;
+	switch(inAddress.mSelector)
+	{
+		case kAudioControlPropertyScope:
+		case kAudioControlPropertyElement:
+		case kAudioLevelControlPropertyDecibelRange:
+		case kAudioLevelControlPropertyConvertScalarToDecibels:
+		case kAudioLevelControlPropertyConvertDecibelsToScalar:
+			theAnswer = false;
+			break;
+		
+		case kAudioLevelControlPropertyScalarValue:
+		case kAudioLevelControlPropertyDecibelValue:
+		case kAudioBooleanControlPropertyValue:
+			theAnswer = true;
+			break;
+		
+		default:
+			theAnswer = SA_Object::IsPropertySettable(inObjectID, inClientPID, inAddress);
+			break;
+	};
+	return theAnswer;
+}
+
+UInt32	SA_Device::Control_GetPropertyDataSize(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* inQualifierData) const
+{
+	//	For each object, this driver implements all the required properties plus a few extras that
+	//	are useful but not required. There is more detailed commentary about each property in the
+	//	Control_GetPropertyData() method.
+	
+	UInt32 theAnswer = 0;
+	switch(inAddress.mSelector)
+	{
+		case kAudioControlPropertyScope:
+			theAnswer = sizeof(AudioObjectPropertyScope);
+			break;
+
+		case kAudioControlPropertyElement:
+			theAnswer = sizeof(AudioObjectPropertyElement);
+			break;
+
+		case kAudioLevelControlPropertyScalarValue:
+		case kAudioLevelControlPropertyDecibelValue:
+		case kAudioLevelControlPropertyConvertScalarToDecibels:
+		case kAudioLevelControlPropertyConvertDecibelsToScalar:
+			theAnswer = sizeof(Float32);
+			break;
+
+		case kAudioLevelControlPropertyDecibelRange:
+			theAnswer = sizeof(AudioValueRange);
+			break;
+
+		case kAudioBooleanControlPropertyValue:
+			theAnswer = sizeof(UInt32);
+			break;
+
+		default:
+			theAnswer = SA_Object::GetPropertyDataSize(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData);
+			break;
+	};
+	return theAnswer;
+}
+
+void	SA_Device::Control_GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* inQualifierData, UInt32 inDataSize, UInt32& outDataSize, void* outData) const
+{
+	//	For each object, this driver implements all the required properties plus a few extras that
+	//	are useful but not required.
+	//	Every stream has a volume control and a mute control. The values are kept in the state of
+	//	the device, so the state mutex has to be held to access them.
+	
+	bool theIsInput = false, theIsMute = false;
+	int theStreamId = 0;
+	FindControl(inObjectID, theIsInput, theIsMute, theStreamId);
+	
+	switch(inAddress.mSelector)
+	{
+		case kAudioObjectPropertyBaseClass:
+			//	The base class for kAudioVolumeControlClassID is kAudioLevelControlClassID and the
+			//	one for kAudioMuteControlClassID is kAudioBooleanControlClassID
+			ThrowIf(inDataSize < sizeof(AudioClassID), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioObjectPropertyBaseClass for the control");
+			*reinterpret_cast<AudioClassID*>(outData) = theIsMute ? kAudioBooleanControlClassID : kAudioLevelControlClassID;
+			outDataSize = sizeof(AudioClassID);
+			break;
+			
+		case kAudioObjectPropertyClass:
+			//	Controls are of the class, kAudioVolumeControlClassID or kAudioMuteControlClassID
+			ThrowIf(inDataSize < sizeof(AudioClassID), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioObjectPropertyClass for the control");
+			*reinterpret_cast<AudioClassID*>(outData) = theIsMute ? kAudioMuteControlClassID : kAudioVolumeControlClassID;
+			outDataSize = sizeof(AudioClassID);
+			break;
+			
+		case kAudioObjectPropertyOwner:
+			//	The control's owner is the device object
+			ThrowIf(inDataSize < sizeof(AudioObjectID), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioObjectPropertyOwner for the control");
+			*reinterpret_cast<AudioObjectID*>(outData) = GetObjectID();
+			outDataSize = sizeof(AudioObjectID);
+			break;
+			
+		case kAudioControlPropertyScope:
+			//	This property returns the scope that the control is attached to.
+			ThrowIf(inDataSize < sizeof(AudioObjectPropertyScope), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioControlPropertyScope for the control");
+			*reinterpret_cast<AudioObjectPropertyScope*>(outData) = theIsInput ? kAudioObjectPropertyScopeInput : kAudioObjectPropertyScopeOutput;
+			outDataSize = sizeof(AudioObjectPropertyScope);
+			break;
+
+		case kAudioControlPropertyElement:
+			//	This property returns the element that the control is attached to, which is the
+			//	first channel of the stream the control belongs to.
+			{
+				ThrowIf(inDataSize < sizeof(AudioObjectPropertyElement), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioControlPropertyElement for the control");
+				CAMutex::Locker theStateLocker(mStateMutex);
+				*reinterpret_cast<AudioObjectPropertyElement*>(outData) = theStreamId*mChannelsPerFrame+1;
+				outDataSize = sizeof(AudioObjectPropertyElement);
+			}
+			break;
+
+		case kAudioLevelControlPropertyScalarValue:
+			//	This returns the value of the control in the normalized range of 0 to 1.
+			{
+				ThrowIf(theIsMute, CAException(kAudioHardwareUnknownPropertyError), "SA_Device::Control_GetPropertyData: kAudioLevelControlPropertyScalarValue for a mute control");
+				ThrowIf(inDataSize < sizeof(Float32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioLevelControlPropertyScalarValue for the volume control");
+				CAMutex::Locker theStateLocker(mStateMutex);
+				SInt32 theRawValue = theIsInput ? mInputVolumeRawValue[theStreamId] : mOutputVolumeRawValue[theStreamId];
+				*reinterpret_cast<Float32*>(outData) = mVolumeCurve.ConvertRawToScalar(theRawValue);
+				outDataSize = sizeof(Float32);
+			}
+			break;
+
+		case kAudioLevelControlPropertyDecibelValue:
+			//	This returns the dB value of the control.
+			{
+				ThrowIf(theIsMute, CAException(kAudioHardwareUnknownPropertyError), "SA_Device::Control_GetPropertyData: kAudioLevelControlPropertyDecibelValue for a mute control");
+				ThrowIf(inDataSize < sizeof(Float32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioLevelControlPropertyDecibelValue for the volume control");
+				CAMutex::Locker theStateLocker(mStateMutex);
+				SInt32 theRawValue = theIsInput ? mInputVolumeRawValue[theStreamId] : mOutputVolumeRawValue[theStreamId];
+				*reinterpret_cast<Float32*>(outData) = mVolumeCurve.ConvertRawToDB(theRawValue);
+				outDataSize = sizeof(Float32);
+			}
+			break;
+
+		case kAudioLevelControlPropertyDecibelRange:
+			//	This returns the dB range of the control.
+			ThrowIf(theIsMute, CAException(kAudioHardwareUnknownPropertyError), "SA_Device::Control_GetPropertyData: kAudioLevelControlPropertyDecibelRange for a mute control");
+			ThrowIf(inDataSize < sizeof(AudioValueRange), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioLevelControlPropertyDecibelRange for the volume control");
+			reinterpret_cast<AudioValueRange*>(outData)->mMinimum = mVolumeCurve.GetMinimumDB();
+			reinterpret_cast<AudioValueRange*>(outData)->mMaximum = mVolumeCurve.GetMaximumDB();
+			outDataSize = sizeof(AudioValueRange);
+			break;
+
+		case kAudioLevelControlPropertyConvertScalarToDecibels:
+			//	This takes the scalar value in outData and converts it to dB.
+			{
+				ThrowIf(theIsMute, CAException(kAudioHardwareUnknownPropertyError), "SA_Device::Control_GetPropertyData: kAudioLevelControlPropertyConvertScalarToDecibels for a mute control");
+				ThrowIf(inDataSize < sizeof(Float32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioLevelControlPropertyConvertScalarToDecibels for the volume control");
+				Float32 theVolumeValue = *reinterpret_cast<Float32*>(outData);
+				theVolumeValue = std::min(1.0f, std::max(0.0f, theVolumeValue));
+				*reinterpret_cast<Float32*>(outData) = mVolumeCurve.ConvertScalarToDB(theVolumeValue);
+				outDataSize = sizeof(Float32);
+			}
+			break;
+
+		case kAudioLevelControlPropertyConvertDecibelsToScalar:
+			//	This takes the dB value in outData and converts it to scalar.
+			{
+				ThrowIf(theIsMute, CAException(kAudioHardwareUnknownPropertyError), "SA_Device::Control_GetPropertyData: kAudioLevelControlPropertyConvertDecibelsToScalar for a mute control");
+				ThrowIf(inDataSize < sizeof(Float32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioLevelControlPropertyConvertDecibelsToScalar for the volume control");
+				Float32 theVolumeValue = *reinterpret_cast<Float32*>(outData);
+				theVolumeValue = std::min(mVolumeCurve.GetMaximumDB(), std::max(mVolumeCurve.GetMinimumDB(), theVolumeValue));
+				*reinterpret_cast<Float32*>(outData) = mVolumeCurve.ConvertDBToScalar(theVolumeValue);
+				outDataSize = sizeof(Float32);
+			}
+			break;
+
+		case kAudioBooleanControlPropertyValue:
+			//	This returns whether or not the stream is muted.
+			{
+				ThrowIf(!theIsMute, CAException(kAudioHardwareUnknownPropertyError), "SA_Device::Control_GetPropertyData: kAudioBooleanControlPropertyValue for a volume control");
+				ThrowIf(inDataSize < sizeof(UInt32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_GetPropertyData: not enough space for the return value of kAudioBooleanControlPropertyValue for the mute control");
+				CAMutex::Locker theStateLocker(mStateMutex);
+				*reinterpret_cast<UInt32*>(outData) = (theIsInput ? mInputMuteValue[theStreamId] : mOutputMuteValue[theStreamId]) ? 1 : 0;
+				outDataSize = sizeof(UInt32);
+			}
+			break;
+
+		default:
+			SA_Object::GetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, outDataSize, outData);
+			break;
+	};
+}
+
+void	SA_Device::Control_SetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* inQualifierData, UInt32 inDataSize, const void* inData)
+{
+	//	For each object, this driver implements all the required properties plus a few extras that
+	//	are useful but not required. There is more detailed commentary about each property in the
+	//	Control_GetPropertyData() method.
+	
+	bool theIsInput = false, theIsMute = false;
+	int theStreamId = 0;
+	FindControl(inObjectID, theIsInput, theIsMute, theStreamId);
+	
+	//	the value changes are notified to the host after the state lock is released
+	UInt32 theNumberPropertiesChanged = 0;
+	AudioObjectPropertyAddress theChangedProperties[2];
+	
+	switch(inAddress.mSelector)
+	{
+		case kAudioLevelControlPropertyScalarValue:
+		case kAudioLevelControlPropertyDecibelValue:
+			//	The new gain is picked up by the next IO of the stream, which ramps to it.
+			{
+				ThrowIf(theIsMute, CAException(kAudioHardwareUnknownPropertyError), "SA_Device::Control_SetPropertyData: volume value for a mute control");
+				ThrowIf(inDataSize != sizeof(Float32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_SetPropertyData: wrong size for the data for the volume control");
+				
+				//	convert the new value to the raw one, clamping it to the range of the curve
+				Float32 theNewValue = *reinterpret_cast<const Float32*>(inData);
+				SInt32 theNewRawValue;
+				if(inAddress.mSelector == kAudioLevelControlPropertyScalarValue)
+				{
+					theNewValue = std::min(1.0f, std::max(0.0f, theNewValue));
+					theNewRawValue = mVolumeCurve.ConvertScalarToRaw(theNewValue);
+				}
+				else
+				{
+					theNewValue = std::min(mVolumeCurve.GetMaximumDB(), std::max(mVolumeCurve.GetMinimumDB(), theNewValue));
+					theNewRawValue = mVolumeCurve.ConvertDBToRaw(theNewValue);
+				}
+				
+				CAMutex::Locker theStateLocker(mStateMutex);
+				SInt32& theRawValue = theIsInput ? mInputVolumeRawValue[theStreamId] : mOutputVolumeRawValue[theStreamId];
+				if(theRawValue != theNewRawValue)
+				{
+					theRawValue = theNewRawValue;
+					_HW_SetStreamGain(theIsInput, theStreamId);
+					theChangedProperties[0].mSelector = kAudioLevelControlPropertyScalarValue;
+					theChangedProperties[1].mSelector = kAudioLevelControlPropertyDecibelValue;
+					theNumberPropertiesChanged = 2;
+				}
+			}
+			break;
+		
+		case kAudioBooleanControlPropertyValue:
+			{
+				ThrowIf(!theIsMute, CAException(kAudioHardwareUnknownPropertyError), "SA_Device::Control_SetPropertyData: mute value for a volume control");
+				ThrowIf(inDataSize != sizeof(UInt32), CAException(kAudioHardwareBadPropertySizeError), "SA_Device::Control_SetPropertyData: wrong size for the data for kAudioBooleanControlPropertyValue");
+				
+				bool theNewValue = *reinterpret_cast<const UInt32*>(inData) != 0;
+				CAMutex::Locker theStateLocker(mStateMutex);
+				bool& theMuteValue = theIsInput ? mInputMuteValue[theStreamId] : mOutputMuteValue[theStreamId];
+				if(theMuteValue != theNewValue)
+				{
+					theMuteValue = theNewValue;
+					_HW_SetStreamGain(theIsInput, theStreamId);
+					theChangedProperties[0].mSelector = kAudioBooleanControlPropertyValue;
+					theNumberPropertiesChanged = 1;
+				}
+			}
+			break;
+		
+		default:
+			SA_Object::SetPropertyData(inObjectID, inClientPID, inAddress, inQualifierDataSize, inQualifierData, inDataSize, inData);
+			break;
+	};
+	
+	//	send out notifications
+	if(theNumberPropertiesChanged > 0)
+	{
+		for(UInt32 theIndex = 0; theIndex < theNumberPropertiesChanged; ++theIndex)
+		{
+			theChangedProperties[theIndex].mScope = kAudioObjectPropertyScopeGlobal;
+			theChangedProperties[theIndex].mElement = kAudioObjectPropertyElementMaster;
+		}
+		SA_PlugIn::Host_PropertiesChanged(inObjectID, theNumberPropertiesChanged, theChangedProperties);
+	}
+}
+
 #pragma mark IO Operations
 
 void	SA_Device::StartIO()
@@ -1311,9 +1708,17 @@ void	SA_Device::StartIO()
 	//	we only tell the hardware to start if this is the first time IO has been started
 	if(mStartCount == 0)
 	{
-        gDevice_NumberTimeStamps = 0;
-        gDevice_AnchorSampleTime = 0.0;
-
+		//	the time stamp period follows the Jack period, the HAL picks up a new one with a
+		//	configuration change. Until then IO runs with the one it knows.
+		if(stamp_period(*shmJackPeriod, mRingBufferFrameSize) != mZeroTimeStampPeriod)
+		{
+			AudioObjectID theDeviceObjectID = GetObjectID();
+			UInt64 theChangeAction = kConfigChangeAction(_HW_GetSampleRate(), 0);
+			CADispatchQueue::GetGlobalSerialQueue().Dispatch(false,	^{
+																		SA_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, theChangeAction, NULL);
+																	});
+		}
+		
 		kern_return_t theError = _HW_StartIO();
 		ThrowIfKernelError(theError, CAException(theError), "SA_Device::StartIO: failed to start because of an error calling down to the driver");
 	}
@@ -1339,30 +1744,7 @@ void	SA_Device::StopIO()
 
 void	SA_Device::GetZeroTimeStamp(Float64& outSampleTime, UInt64& outHostTime, UInt64& outSeed)
 {
-    Float64 theHostTickOffset;
-    UInt64 theNextHostTime;
-
-    //  calculate the next host time
-    Float64 theHostTicksPerRingBuffer = gDevice_HostTicksPerFrame * ((Float64)mRingBufferFrameSize);
-    theHostTickOffset = ((Float64)(gDevice_NumberTimeStamps + 1)) * theHostTicksPerRingBuffer;
-    theNextHostTime = gDevice_AnchorHostTime + ((UInt64)theHostTickOffset);
-    //  go to the next time if the next host time is less than the current time
-    if(theNextHostTime <= mach_absolute_time())
-    {
-        ++gDevice_NumberTimeStamps;
-    }
-    
-    //  set the return values
-    if (*shmSyncMode == 1) {
-        outSampleTime = (*shmNumberTimeStamps) * mRingBufferFrameSize;
-        outHostTime = *shmZeroHostTime;
-    } else {
-        outSampleTime = gDevice_NumberTimeStamps * mRingBufferFrameSize;
-        outHostTime = gDevice_AnchorHostTime + (((Float64)gDevice_NumberTimeStamps) * theHostTicksPerRingBuffer);
-        *shmNumberTimeStamps = gDevice_NumberTimeStamps;
-        *shmZeroHostTime = outHostTime;
-    }
-    outSeed = *shmSeed;
+    mCore.get_zero_time_stamp(mach_absolute_time(), outSampleTime, outHostTime, outSeed);
 }
 
 void	SA_Device::WillDoIOOperation(UInt32 inOperationID, bool& outWillDo, bool& outWillDoInPlace) const
@@ -1419,62 +1801,14 @@ void	SA_Device::EndIOOperation(UInt32 inOperationID, UInt32 inIOBufferFrameSize,
 
 void	SA_Device::ReadInputData(int streamId, UInt32 inIOBufferFrameSize, Float64 inSampleTime, void* outBuffer)
 {
-	//	we need to be holding the IO lock to do this
-	CAMutex::Locker theIOLocker(mIOMutex);
-    sample_t *RingBuffer = buf_down[streamId];
-    volatile uint64_t *frameNum = shmReadFrameNumber[streamId];
-	
-	//	figure out where we are starting
-	UInt64 theSampleTime = static_cast<UInt64>(inSampleTime);
-	UInt32 theStartFrameOffset = theSampleTime % mRingBufferFrameSize;
-	
-	//	figure out how many frames we need to copy
-	UInt32 theNumberFramesToCopy1 = inIOBufferFrameSize;
-	UInt32 theNumberFramesToCopy2 = 0;
-	if((theStartFrameOffset + theNumberFramesToCopy1) > mRingBufferFrameSize)
-	{
-		theNumberFramesToCopy1 = mRingBufferFrameSize - theStartFrameOffset;
-		theNumberFramesToCopy2 = inIOBufferFrameSize - theNumberFramesToCopy1;
-	}
-	
-	//	do the copying (the byte sizes here assume a 16 bit stereo sample format)
-    Byte* theDestination = reinterpret_cast<Byte*>(outBuffer);
-    memcpy(theDestination, RingBuffer+theStartFrameOffset*2, theNumberFramesToCopy1 * 8);
-    if(theNumberFramesToCopy2 > 0)
-    {
-        memcpy(theDestination + (theNumberFramesToCopy1 * 8), RingBuffer, theNumberFramesToCopy2 * 8);
-    }
-    *frameNum = static_cast<UInt64>(inSampleTime) + inIOBufferFrameSize;
+	//	wait-free, the configuration is read from the snapshot published by mCore
+    mCore.read_input(streamId, inIOBufferFrameSize, inSampleTime, outBuffer);
 }
 
 void	SA_Device::WriteOutputData(int streamId, UInt32 inIOBufferFrameSize, Float64 inSampleTime, const void* inBuffer)
 {
-	//	we need to be holding the IO lock to do this
-	CAMutex::Locker theIOLocker(mIOMutex);
-    sample_t *RingBuffer = buf_up[streamId];
-    volatile uint64_t *frameNum = shmWriteFrameNumber[streamId];
-	
-	//	figure out where we are starting
-	UInt64 theSampleTime = static_cast<UInt64>(inSampleTime);
-	UInt32 theStartFrameOffset = theSampleTime % mRingBufferFrameSize;
-	
-	//	figure out how many frames we need to copy
-	UInt32 theNumberFramesToCopy1 = inIOBufferFrameSize;
-	UInt32 theNumberFramesToCopy2 = 0;
-	if((theStartFrameOffset + theNumberFramesToCopy1) > mRingBufferFrameSize)
-	{
-		theNumberFramesToCopy1 = mRingBufferFrameSize - theStartFrameOffset;
-		theNumberFramesToCopy2 = inIOBufferFrameSize - theNumberFramesToCopy1;
-	}
-	
-	//	do the copying (the byte sizes here assume a 16 bit stereo sample format)
-    const Byte* theSource = reinterpret_cast<const Byte*>(inBuffer);
-    memcpy(RingBuffer+theStartFrameOffset*2, theSource, theNumberFramesToCopy1 * 8);
-    if(theNumberFramesToCopy2 > 0)
-    {
-        memcpy(RingBuffer, theSource + (theNumberFramesToCopy1 * 8), theNumberFramesToCopy2 * 8);
-    }
-    *frameNum = static_cast<UInt64>(inSampleTime) + inIOBufferFrameSize;
+	//	wait-free, the configuration is read from the snapshot published by mCore
+    mCore.write_output(streamId, inIOBufferFrameSize, inSampleTime, inBuffer);
 }
 
 #pragma mark Hardware Accessors
@@ -1485,6 +1819,20 @@ CFStringRef	SA_Device::HW_CopyDeviceUID()
 	return theAnswer;
 }
 
+CFStringRef	SA_Device::CopyDeviceUID() const
+{
+	//	the first device keeps the UID it always had, so the settings made for it still apply
+	CFStringRef theAnswer = (instance == 0) ? HW_CopyDeviceUID() : CFStringCreateWithFormat(NULL, NULL, CFSTR(kDeviceUIDPattern), (int)instance + 1);
+	return theAnswer;
+}
+
+CFStringRef	SA_Device::CopyDeviceName() const
+{
+	//	"DeviceName" is a key into the localizable strings, the other devices are numbered
+	CFStringRef theAnswer = (instance == 0) ? CFSTR("DeviceName") : CFStringCreateWithFormat(NULL, NULL, CFSTR(kDeviceNamePattern), (int)instance + 1);
+	return theAnswer;
+}
+
 void	SA_Device::_HW_Open()
 {
     // Initialize shared memory to communicate JackBridge daemon
@@ -1502,8 +1850,24 @@ void	SA_Device::_HW_Open()
     }
     *shmSeed = 1;
     *shmSyncMode = 0;
+    *shmTimebase = JB_TIMEBASE_HOST;
     *shmDriverStatus = mDriverStatus = JB_DRV_STATUS_ACTIVE;
-    mRingBufferFrameSize = STRBUFNUM / 2;
+
+    // hand the shm over to the IO core
+    for(int i=0; i<NUM_INPUT_STREAMS; i++) {
+        mCore.attach_input(i, buf_down[i], shmReadFrameNumber[i]);
+    }
+    for(int i=0; i<NUM_OUTPUT_STREAMS; i++) {
+        mCore.attach_output(i, buf_up[i], shmWriteFrameNumber[i]);
+    }
+    mCore.attach_timebase(shmNumberTimeStamps, shmZeroHostTime, shmSeed, shmSyncMode);
+    mCore.attach_daemon(shmDaemonFrame, shmJackPeriod);
+
+    // start at Jack's sample rate if the daemon runs already, see UpdateLatency()
+    if (IsSupportedSampleRate(shm_jack_sample_rate())) {
+        _HW_SetSampleRate(shm_jack_sample_rate());
+    }
+    _HW_SetRingFormat();
   
     syslog(LOG_WARNING, "JackBridge: Device #%d initialized. ", instance);
 }
@@ -1521,7 +1885,7 @@ kern_return_t	SA_Device::_HW_StartIO()
         return kAudioHardwareNotRunningError;
     }
     *shmDriverStatus = mDriverStatus = JB_DRV_STATUS_STARTED;
-    gDevice_AnchorHostTime = 0;
+    mCore.start(0);
     return 0;
 }
 
@@ -1534,44 +1898,199 @@ void	SA_Device::_HW_StopIO()
 
 UInt64	SA_Device::_HW_GetSampleRate() const
 {
-	return mSampleRateShadow;
+	return mSampleRateShadow.load(std::memory_order_relaxed);
+}
+
+UInt32	SA_Device::_HW_GetJackLatency() const
+{
+	//	the daemon's period, ignored until it fits the ring
+	return (*shmJackPeriod < mRingBufferFrameSize) ? (UInt32)*shmJackPeriod : 0;
 }
 
 kern_return_t	SA_Device::_HW_SetSampleRate(UInt64 inNewSampleRate)
 {
-    mSampleRateShadow = inNewSampleRate;
+    mSampleRateShadow.store(inNewSampleRate, std::memory_order_relaxed);
 	return 0;
 }
 
+void	SA_Device::_HW_SetRingFormat()
+{
+	//	called with the state mutex held while IO is stopped. The rings hold the same time at
+	//	every sample rate, so their frames follow the channels and the sample rate.
+	mRingBufferFrameSize = JB_RING_FRAMES(mChannelsPerFrame, mSampleRateShadow);
+	*shmChannels = mChannelsPerFrame;
+	*shmSampleRate = mSampleRateShadow;
+	mCore.set_format(mChannelsPerFrame, mRingBufferFrameSize);
+	
+	//	calculate the host ticks per frame
+	struct mach_timebase_info theTimeBaseInfo;
+	mach_timebase_info(&theTimeBaseInfo);
+	Float64 theHostClockFrequency = static_cast<Float64>(theTimeBaseInfo.denom) / theTimeBaseInfo.numer;
+	theHostClockFrequency *= 1000000000.0;
+	mCore.set_host_ticks_per_frame(theHostClockFrequency / mSampleRateShadow);
+	
+	_HW_SetZeroTimeStampPeriod();
+	
+	//	the IO core sees the new format in one piece
+	mCore.commit();
+}
+
+void	SA_Device::_HW_SetZeroTimeStampPeriod()
+{
+	//	called with the state mutex held while IO is stopped. The daemon follows the period
+	//	set in the shm and tells the Jack period it derives from.
+	mZeroTimeStampPeriod = stamp_period(*shmJackPeriod, mRingBufferFrameSize);
+	*shmStampPeriod = mZeroTimeStampPeriod;
+	mCore.set_period_frames(mZeroTimeStampPeriod);
+}
+
+void	SA_Device::_HW_SetStreamGain(bool inIsInput, int inStreamId)
+{
+	//	called with the state mutex held. The lowest volume is silence.
+	SInt32 theRawValue = inIsInput ? mInputVolumeRawValue[inStreamId] : mOutputVolumeRawValue[inStreamId];
+	bool theMuteValue = inIsInput ? mInputMuteValue[inStreamId] : mOutputMuteValue[inStreamId];
+	Float32 theGain = 0.0f;
+	if(!theMuteValue && (theRawValue > mVolumeCurve.GetMinimumRaw()))
+	{
+		theGain = powf(10.0f, mVolumeCurve.ConvertRawToDB(theRawValue) / 20.0f);
+	}
+	
+	if(inIsInput)
+	{
+		mCore.set_input_gain(inStreamId, theGain);
+	}
+	else
+	{
+		mCore.set_output_gain(inStreamId, theGain);
+	}
+}
+
 #pragma mark Implementation
 
+const Float64	SA_Device::kSampleRates[SA_Device::kNumberOfSampleRates] = { 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 };
+
+bool	SA_Device::IsSupportedSampleRate(Float64 inSampleRate)
+{
+	for(UInt32 theIndex = 0; theIndex < kNumberOfSampleRates; ++theIndex)
+	{
+		if(kSampleRates[theIndex] == inSampleRate)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void	SA_Device::MakeStreamFormat(Float64 inSampleRate, UInt32 inNumberChannels, AudioStreamBasicDescription& outFormat)
+{
+	outFormat.mSampleRate = inSampleRate;
+	outFormat.mFormatID = kAudioFormatLinearPCM;
+	outFormat.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsPacked;
+	outFormat.mBytesPerPacket = inNumberChannels * sizeof(sample_t);
+	outFormat.mFramesPerPacket = 1;
+	outFormat.mBytesPerFrame = inNumberChannels * sizeof(sample_t);
+	outFormat.mChannelsPerFrame = inNumberChannels;
+	outFormat.mBitsPerChannel = 32;
+	outFormat.mReserved = 0;
+}
+
 void	SA_Device::PerformConfigChange(UInt64 inChangeAction, void* inChangeInfo)
 {
 	#pragma unused(inChangeInfo)
 	
-	//	this device only supports chagning the sample rate, which is stored in inChangeAction
-	UInt64 theNewSampleRate = inChangeAction;
+	//	the new sample rate and number of channels (0: unchanged) are stored in inChangeAction,
+	//	unless it is a latency change
+	UInt64 theNewSampleRate = kConfigChangeSampleRate(inChangeAction);
+	UInt32 theNewNumberChannels = kConfigChangeChannels(inChangeAction);
 	
-	//	make sure we support the new sample rate
-	if((theNewSampleRate == 44100) || (theNewSampleRate == 48000))
+	if(inChangeAction == kConfigChangeLatency)
+	{
+		//	the host reads the latency and the safety offsets again after this. They change the
+		//	timing of the IO, so the margins measured so far don't count anymore.
+		CAMutex::Locker theStateLocker(mStateMutex);
+		mDeviceLatency = _HW_GetJackLatency();
+		mInputLatency = mMeasuredInputLatency;
+		mOutputLatency = mMeasuredOutputLatency;
+		mCore.discard_margins();
+		mLatencyChangePending = false;
+		mLatencyHoldOff = kLatencyChangeInterval;
+	}
+	else if(IsSupportedSampleRate(theNewSampleRate) && (theNewNumberChannels <= JB_MAX_CHANNELS))
 	{
-		//	we need to lock the state lock around telling the hardware about the new sample rate
+		//	we need to lock the state lock around telling the hardware about the new format
 		CAMutex::Locker theStateLocker(mStateMutex);
 		_HW_SetSampleRate(theNewSampleRate);
+		if(theNewNumberChannels != 0)
+		{
+			mChannelsPerFrame = theNewNumberChannels;
+		}
+		_HW_SetRingFormat();
+		mRateChangePending = false;
+	}
+}
 
-        //  calculate the host ticks per frame
-        struct mach_timebase_info theTimeBaseInfo;
-        mach_timebase_info(&theTimeBaseInfo);
-        Float64 theHostClockFrequency = theTimeBaseInfo.denom / theTimeBaseInfo.numer;
-        theHostClockFrequency *= 1000000000.0;
-        gDevice_HostTicksPerFrame = theHostClockFrequency / theNewSampleRate;
+void	SA_Device::UpdateLatency()
+{
+	//	Called about once a second. While IO runs the IO core measures how far the first stream
+	//	of each direction is from the daemon. The host only takes new latencies and safety
+	//	offsets in a configuration change, which is requested when a value moved further than
+	//	the margin kept on top of the safety offset. As the safety offset shifts the IO it is
+	//	measured from, there is no other request for kLatencyChangeInterval calls after one.
+	CAMutex::Locker theStateLocker(mStateMutex);
+	if(mLatencyHoldOff > 0)
+	{
+		--mLatencyHoldOff;
+	}
+	
+	//	The daemon streams silence while the rings run at another rate than Jack, so the device
+	//	follows the rate the daemon publishes. A declined request is retried after the interval.
+	UInt64 theJackSampleRate = shm_jack_sample_rate();
+	if(IsSupportedSampleRate(theJackSampleRate) && (theJackSampleRate != _HW_GetSampleRate()) && !mRateChangePending && (mLatencyHoldOff == 0))
+	{
+		mRateChangePending = true;
+		AudioObjectID theDeviceObjectID = GetObjectID();
+		UInt64 theChangeAction = kConfigChangeAction(theJackSampleRate, 0);
+		CADispatchQueue::GetGlobalSerialQueue().Dispatch(false,	^{
+																	SA_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, theChangeAction, NULL);
+																});
 	}
+	if(mStartCount > 0)
+	{
+		mCore.update_latency(mInputLatency, mOutputLatency, mMeasuredInputLatency, mMeasuredOutputLatency);
+		bool theMoved = (_HW_GetJackLatency() != mDeviceLatency) || IsLatencyMoved(mInputLatency, mMeasuredInputLatency) || IsLatencyMoved(mOutputLatency, mMeasuredOutputLatency);
+		if(theMoved && !mLatencyChangePending && (mLatencyHoldOff == 0))
+		{
+			mLatencyChangePending = true;
+			AudioObjectID theDeviceObjectID = GetObjectID();
+			CADispatchQueue::GetGlobalSerialQueue().Dispatch(false,	^{
+																		SA_PlugIn::Host_RequestDeviceConfigurationChange(theDeviceObjectID, kConfigChangeLatency, NULL);
+																	});
+		}
+	}
+}
+
+bool	SA_Device::IsLatencyMoved(const BridgeDeviceCore::latency_t& inReported, const BridgeDeviceCore::latency_t& inMeasured)
+{
+	//	differences within the safety margin don't make the host reconfigure
+	UInt32 theSafetyOffsetDelta = (inMeasured.safetyOffset > inReported.safetyOffset) ? inMeasured.safetyOffset - inReported.safetyOffset : inReported.safetyOffset - inMeasured.safetyOffset;
+	UInt32 theLatencyDelta = (inMeasured.latency > inReported.latency) ? inMeasured.latency - inReported.latency : inReported.latency - inMeasured.latency;
+	return (theSafetyOffsetDelta > BRIDGE_CORE_SAFETY_FRAMES) || (theLatencyDelta > BRIDGE_CORE_SAFETY_FRAMES);
 }
 
 void	SA_Device::AbortConfigChange(UInt64 inChangeAction, void* inChangeInfo)
 {
-	#pragma unused(inChangeAction, inChangeInfo)
+	#pragma unused(inChangeInfo)
 	
-	//	this device doesn't need to do anything special if a change request gets aborted
+	//	a latency or sample rate change may be requested again once the interval has passed
+	CAMutex::Locker theStateLocker(mStateMutex);
+	if(inChangeAction == kConfigChangeLatency)
+	{
+		mLatencyChangePending = false;
+	}
+	else
+	{
+		mRateChangePending = false;
+	}
+	mLatencyHoldOff = kLatencyChangeInterval;
 }
 
@@ -60,18 +60,21 @@
 //	PublicUtility Includes
 #include "CACFString.h"
 #include "CAMutex.h"
+#include "CAVolumeCurve.h"
 
 // For Jack
 #include <syslog.h>
 #include <sys/shm.h>
 #include <unistd.h>
 #include <string.h>
+#include <atomic>
 #include <errno.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #define _ERROR_SYSLOG_ 1
 #include "JackBridge.h"
+#include "BridgeDeviceCore.h"
 
 //==================================================================================================
 //	SA_Device
@@ -84,7 +87,7 @@ class SA_Device
 
 #pragma mark Construction/Destruction
 public:
-								SA_Device(AudioObjectID inObjectID, UInt32 instance);
+								SA_Device(AudioObjectID inObjectID, UInt32 instance, UInt32 inChannelsPerFrame = JB_DEFAULT_CHANNELS);
 					
 	virtual void				Activate();
 	virtual void				Deactivate();
@@ -96,6 +99,9 @@ private:
     bool	IsStreamObjectID(AudioObjectID inObjectID) const;
     bool 	IsInputStreamID(AudioObjectID inObjectID) const;
     int 	getStreamID(AudioObjectID inObjectID) const;
+    bool	IsControlObjectID(AudioObjectID inObjectID) const;
+    bool	FindControl(AudioObjectID inObjectID, bool& outIsInput, bool& outIsMute, int& outStreamId) const;
+    UInt32	CopySubObjectIDs(AudioObjectPropertyScope inScope, bool inStreams, bool inControls, UInt32 inMaxItems, AudioObjectID* outIDs) const;
 
 #pragma mark Property Operations
 public:
@@ -121,6 +127,14 @@ private:
 	void						Stream_GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* inQualifierData, UInt32 inDataSize, UInt32& outDataSize, void* outData) const;
 	void						Stream_SetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* inQualifierData, UInt32 inDataSize, const void* inData);
 
+#pragma mark Control Property Operations
+private:
+	bool						Control_HasProperty(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress) const;
+	bool						Control_IsPropertySettable(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress) const;
+	UInt32						Control_GetPropertyDataSize(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* inQualifierData) const;
+	void						Control_GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* inQualifierData, UInt32 inDataSize, UInt32& outDataSize, void* outData) const;
+	void						Control_SetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, const AudioObjectPropertyAddress& inAddress, UInt32 inQualifierDataSize, const void* inQualifierData, UInt32 inDataSize, const void* inData);
+
 #pragma mark IO Operations
 public:
 	void						StartIO();
@@ -146,37 +160,84 @@ private:
 	kern_return_t				_HW_StartIO();
 	void						_HW_StopIO();
 	UInt64						_HW_GetSampleRate() const;
+	UInt32						_HW_GetJackLatency() const;
 	kern_return_t				_HW_SetSampleRate(UInt64 inNewSampleRate);
+	void						_HW_SetStreamGain(bool inIsInput, int inStreamId);
+	void						_HW_SetRingFormat();
+	void						_HW_SetZeroTimeStampPeriod();
 
 #pragma mark Implementation
 #define kDeviceUIDPattern   "JackBridgeDevice-%d"
 #define kDeviceUID          "JackBridgeDeviceUID"
+#define kDeviceNamePattern  "JackBridge #%d"
 #define kDeviceModelUID     "JackBridgeDeviceModelUID"
+
+// volume controls: raw values in 0.1dB steps, the minimum is silence
+#define kVolumeMinRawValue  0
+#define kVolumeMaxRawValue  960
+#define kVolumeMinDBValue   -96.0f
+#define kVolumeMaxDBValue   0.0f
+
+// inChangeAction of a configuration change: sample rate | channels per frame (0: unchanged)
+#define kConfigChangeAction(rate, channels) ((UInt64)(rate) | ((UInt64)(channels) << 32))
+#define kConfigChangeSampleRate(action)     ((action) & 0xFFFFFFFFULL)
+#define kConfigChangeChannels(action)       ((UInt32)((action) >> 32))
+// inChangeAction applying the latency and safety offsets measured, see UpdateLatency()
+#define kConfigChangeLatency                (1ULL << 63)
+// UpdateLatency() calls (about a second each) after a latency change, or a declined
+// change, before the next request
+#define kLatencyChangeInterval              10
     
 public:
-    CFStringRef					CopyDeviceUID() const	{ return CFSTR(kDeviceUID); };
+    UInt32						GetInstance() const		{ return instance; }
+    CFStringRef					CopyDeviceUID() const;
+    CFStringRef					CopyDeviceName() const;
+	void						UpdateLatency();
 	void						PerformConfigChange(UInt64 inChangeAction, void* inChangeInfo);
 	void						AbortConfigChange(UInt64 inChangeAction, void* inChangeInfo);
 
 private:
+	static bool					IsSupportedSampleRate(Float64 inSampleRate);
+	static bool					IsLatencyMoved(const BridgeDeviceCore::latency_t& inReported, const BridgeDeviceCore::latency_t& inMeasured);
+	static void					MakeStreamFormat(Float64 inSampleRate, UInt32 inNumberChannels, AudioStreamBasicDescription& outFormat);
+
 	enum
 	{
-								kNumberOfSubObjects					= NUM_INPUT_STREAMS + NUM_OUTPUT_STREAMS,
-								kNumberOfInputSubObjects			= NUM_INPUT_STREAMS,
-								kNumberOfOutputSubObjects			= NUM_OUTPUT_STREAMS,
+								kNumberOfSubObjects					= (NUM_INPUT_STREAMS + NUM_OUTPUT_STREAMS) * 3,
+								kNumberOfInputSubObjects			= NUM_INPUT_STREAMS * 3,
+								kNumberOfOutputSubObjects			= NUM_OUTPUT_STREAMS * 3,
 								
 								kNumberOfStreams					= NUM_INPUT_STREAMS + NUM_OUTPUT_STREAMS,
 								kNumberOfInputStreams				= NUM_INPUT_STREAMS,
 								kNumberOfOutputStreams				= NUM_OUTPUT_STREAMS,
 								
-								kNumberOfControls					= 0
+								//	a volume and a mute control per stream
+								kNumberOfControls					= (NUM_INPUT_STREAMS + NUM_OUTPUT_STREAMS) * 2,
+								kNumberOfInputControls				= NUM_INPUT_STREAMS * 2,
+								kNumberOfOutputControls				= NUM_OUTPUT_STREAMS * 2,
+								
+								kNumberOfSampleRates				= 6
 	};
+	static const Float64		kSampleRates[kNumberOfSampleRates];
 	
 	CAMutex						mStateMutex;
-	CAMutex						mIOMutex;
 	UInt64						mStartCount;
-	UInt64						mSampleRateShadow;
+	std::atomic<UInt64>			mSampleRateShadow;	//	written under the state lock, read without it
 	UInt32						mRingBufferFrameSize;
+	UInt32						mZeroTimeStampPeriod;
+	
+	//	reported to the host, only changed by a configuration change, see UpdateLatency()
+	UInt32						mDeviceLatency;
+	BridgeDeviceCore::latency_t	mInputLatency;
+	BridgeDeviceCore::latency_t	mOutputLatency;
+	
+	//	measured while IO runs
+	BridgeDeviceCore::latency_t	mMeasuredInputLatency;
+	BridgeDeviceCore::latency_t	mMeasuredOutputLatency;
+	bool						mLatencyChangePending;
+	bool						mRateChangePending;		//	to Jack's sample rate, see UpdateLatency()
+	UInt32						mLatencyHoldOff;
+	UInt32						mChannelsPerFrame;
 	UInt32                  	mDriverStatus;
 	
 	AudioObjectID				mInputStreamObjectID[NUM_INPUT_STREAMS];
@@ -184,13 +245,22 @@ private:
 	
 	AudioObjectID				mOutputStreamObjectID[NUM_OUTPUT_STREAMS];
 	bool						mOutputStreamIsActive[NUM_OUTPUT_STREAMS];
+	
+	AudioObjectID				mInputVolumeControlObjectID[NUM_INPUT_STREAMS];
+	AudioObjectID				mInputMuteControlObjectID[NUM_INPUT_STREAMS];
+	SInt32						mInputVolumeRawValue[NUM_INPUT_STREAMS];
+	bool						mInputMuteValue[NUM_INPUT_STREAMS];
+	
+	AudioObjectID				mOutputVolumeControlObjectID[NUM_OUTPUT_STREAMS];
+	AudioObjectID				mOutputMuteControlObjectID[NUM_OUTPUT_STREAMS];
+	SInt32						mOutputVolumeRawValue[NUM_OUTPUT_STREAMS];
+	bool						mOutputMuteValue[NUM_OUTPUT_STREAMS];
+	
+	CAVolumeCurve				mVolumeCurve;
 
 #pragma mark jackrouter interfaces
 private:
-    Float64                  gDevice_HostTicksPerFrame;
-    UInt64                   gDevice_NumberTimeStamps;
-    Float64                  gDevice_AnchorSampleTime;
-    UInt64                   gDevice_AnchorHostTime;
+    BridgeDeviceCore         mCore;
 };
 
 #endif	//	__SA_Device_h__
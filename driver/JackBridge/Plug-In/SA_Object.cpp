@@ -222,13 +222,20 @@ SA_ObjectMap::SA_ObjectMap()
 :
 	mMutex("SA_ObjectMap Mutex"),
 	mNextObjectID(32),
-	mObjectInfoList()
+	mObjectInfoList(),
+	mIndex(NULL),
+	mGracePeriod()
 {
 	mObjectInfoList.reserve(256);
 }
 
 SA_ObjectMap::~SA_ObjectMap()
 {
+	delete mIndex.load();
+	for(ObjectInfoList::iterator theIterator = mObjectInfoList.begin(); theIterator != mObjectInfoList.end(); ++theIterator)
+	{
+		delete *theIterator;
+	}
 }
 
 void	SA_ObjectMap::StaticInitializer()
@@ -275,7 +282,7 @@ SA_Object*	SA_ObjectMap::CopyObjectByObjectID(AudioObjectID inObjectID)
 	SA_Object* theAnswer = NULL;
 	if(inObjectID != 0)
 	{
-		CAMutex::Locker theLocker(sInstance->mMutex);
+		//	no lock, see _CopyObjectByObjectID()
 		theAnswer = sInstance->_CopyObjectByObjectID(inObjectID);
 	}
 	return theAnswer;
@@ -287,7 +294,7 @@ UInt64	SA_ObjectMap::RetainObject(SA_Object* inObject)
 	UInt64 theAnswer = 0;
 	if(inObject != NULL)
 	{
-		CAMutex::Locker theLocker(sInstance->mMutex);
+		//	no lock, see _RetainObject()
 		theAnswer = sInstance->_RetainObject(inObject);
 	}
 	return theAnswer;
@@ -299,7 +306,7 @@ UInt64	SA_ObjectMap::ReleaseObject(SA_Object* inObject)
 	UInt64 theAnswer = 0;
 	if(inObject != NULL)
 	{
-		CAMutex::Locker theLocker(sInstance->mMutex);
+		//	only the last reference is released with the lock held, see _ReleaseObject()
 		theAnswer = sInstance->_ReleaseObject(inObject);
 	}
 	return theAnswer;
@@ -334,30 +341,34 @@ bool	SA_ObjectMap::_MapObject(AudioObjectID inObjectID, SA_Object* inObject)
 	//	we don't do mappings for IDs of 0 or NULL object pointers
 	if((inObjectID != 0) && (inObject != NULL))
 	{
-		//	look to see if the ID is already attached to an object
-		ObjectInfoList::iterator theByIDIterator = std::find(mObjectInfoList.begin(), mObjectInfoList.end(), inObjectID);
-		if(theByIDIterator == mObjectInfoList.end())
+		//	look to see if the ID is already attached to an object. The mutex is held, so the
+		//	published index is up to date.
+		ObjectInfo* theByIDInfo = FindByObjectID(mIndex.load(), inObjectID);
+		if(theByIDInfo == NULL)
 		{
 			//	it is not, so we're going to do a mapping
 			theAnswer = true;
 			
 			//	look to see if the object is already in the list
-			ObjectInfoList::iterator theByPtrIterator = std::find(mObjectInfoList.begin(), mObjectInfoList.end(), inObject);
-			if(theByPtrIterator != mObjectInfoList.end())
+			ObjectInfo* theByPtrInfo = FindByObject(mIndex.load(), inObject);
+			if(theByPtrInfo != NULL)
 			{
 				//	it is, so just add the new ID to it's ID list
-				theByPtrIterator->mObjectIDList.push_back(inObjectID);
+				theByPtrInfo->mObjectIDList.push_back(inObjectID);
 			}
 			else
 			{
 				//	this is the first time this object has been mapped, so add a new entry to the list
-				mObjectInfoList.push_back(ObjectInfo(inObjectID, inObject));
+				mObjectInfoList.push_back(new ObjectInfo(inObjectID, inObject));
 			}
+			
+			//	make the new ID visible to the lookups
+			_PublishIndex();
 		}
 		else
 		{
 			//	the given ID is already attached to an object, this is a programming error
-			DebugMsg("HALB_ObjectMap::_MapObject: %d cannot be mapped to object %p because it is already mapped to %p", (int)inObjectID, inObject, theByIDIterator->mObject);
+			DebugMsg("HALB_ObjectMap::_MapObject: %d cannot be mapped to object %p because it is already mapped to %p", (int)inObjectID, inObject, theByIDInfo->mObject);
 		}
 	}
 	
@@ -370,28 +381,36 @@ void	SA_ObjectMap::_UnmapObject(AudioObjectID inObjectID, SA_Object* inObject)
 	if((inObjectID != 0) && (inObject != NULL))
 	{
 		//	find the object this ID is attached to
-		ObjectInfoList::iterator theIterator = std::find(mObjectInfoList.begin(), mObjectInfoList.end(), inObjectID);
-		if(theIterator != mObjectInfoList.end())
+		ObjectInfo* theInfo = FindByObjectID(mIndex.load(), inObjectID);
+		if(theInfo != NULL)
 		{
 			//	make sure that it is the object we expect to be unmapping
-			if(theIterator->mObject == inObject)
+			if(theInfo->mObject == inObject)
 			{
 				//	find the ID in the ID list
-				ObjectIDList::iterator theIDIterator = std::find(theIterator->mObjectIDList.begin(), theIterator->mObjectIDList.end(), inObjectID);
-				if(theIDIterator != theIterator->mObjectIDList.end())
+				ObjectIDList::iterator theIDIterator = std::find(theInfo->mObjectIDList.begin(), theInfo->mObjectIDList.end(), inObjectID);
+				if(theIDIterator != theInfo->mObjectIDList.end())
 				{
 					//	get rid of it
-					theIterator->mObjectIDList.erase(theIDIterator);
+					theInfo->mObjectIDList.erase(theIDIterator);
 					
 					//	get rid of the object if there are no more IDs
-					if(theIterator->mObjectIDList.empty())
+					if(theInfo->mObjectIDList.empty())
 					{
 						//	get rid of the info in the list
-						mObjectInfoList.erase(theIterator);
+						mObjectInfoList.erase(std::find(mObjectInfoList.begin(), mObjectInfoList.end(), theInfo));
+						_PublishIndex();
+						
+						//	no lookup can see the info anymore
+						delete theInfo;
 						
 						//	and destroy the object
 						CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{ DestroyObject(inObject); });
 					}
+					else
+					{
+						_PublishIndex();
+					}
 				}
 			}
 		}
@@ -402,24 +421,16 @@ SA_Object*	SA_ObjectMap::_CopyObjectByObjectID(AudioObjectID inObjectID)
 {
 	SA_Object* theAnswer = NULL;
 	
-	//	find the object this ID is attached to
-	ObjectInfoList::iterator theIterator = std::find(mObjectInfoList.begin(), mObjectInfoList.end(), inObjectID);
-	if(theIterator != mObjectInfoList.end())
+	//	find the object this ID is attached to, the info stays allocated until we leave
+	int theReader = mGracePeriod.enter();
+	ObjectInfo* theInfo = FindByObjectID(mIndex.load(), inObjectID);
+	UInt64 theReferenceCount;
+	if((theInfo != NULL) && RetainInfo(theInfo, theReferenceCount))
 	{
-		//	don't overflow the reference count
-		if(theIterator->mReferenceCount < UINT64_MAX)
-		{
-			//	increment the reference count
-			theIterator->mReferenceCount += 1;
-			
-			//	return the object pointer
-			theAnswer = theIterator->mObject;
-		}
-		else
-		{
-			DebugMsg("SA_ObjectMap::_CopyObjectByObjectID: not copying because the reference count is at maximum");
-		}
+		//	return the object pointer
+		theAnswer = theInfo->mObject;
 	}
+	mGracePeriod.leave(theReader);
 	
 	return theAnswer;
 }
@@ -429,61 +440,182 @@ UInt64	SA_ObjectMap::_RetainObject(SA_Object* inObject)
 	UInt64 theAnswer = 0;
 
 	//	find the info for this object
-	ObjectInfoList::iterator theIterator = std::find(mObjectInfoList.begin(), mObjectInfoList.end(), inObject);
-	if(theIterator != mObjectInfoList.end())
+	int theReader = mGracePeriod.enter();
+	ObjectInfo* theInfo = FindByObject(mIndex.load(), inObject);
+	if(theInfo != NULL)
+	{
+		RetainInfo(theInfo, theAnswer);
+	}
+	mGracePeriod.leave(theReader);
+	
+	return theAnswer;
+}
+
+UInt64	SA_ObjectMap::_ReleaseObject(SA_Object* inObject)
+{
+	UInt64 theAnswer = 0;
+	bool theIsLastReference = false;
+
+	//	find the info for this object and drop the reference unless it is the last one
+	int theReader = mGracePeriod.enter();
+	ObjectInfo* theInfo = FindByObject(mIndex.load(), inObject);
+	if(theInfo != NULL)
 	{
-		//	don't overflow the reference count
-		if(theIterator->mReferenceCount < UINT64_MAX)
+		UInt64 theReferenceCount = theInfo->mReferenceCount.load();
+		while((theReferenceCount > 1) && !theInfo->mReferenceCount.compare_exchange_weak(theReferenceCount, theReferenceCount - 1))
+		{
+			//	retry with the count someone else just changed
+		}
+		
+		if(theReferenceCount > 1)
 		{
-			//	increment the reference count
-			theIterator->mReferenceCount += 1;
+			theAnswer = theReferenceCount - 1;
+		}
+		else if(theReferenceCount == 1)
+		{
+			theIsLastReference = true;
 		}
 		else
 		{
-			DebugMsg("SA_ObjectMap::_RetainObject: not retaining because the reference count is at maximum");
+			DebugMsg("SA_ObjectMap::_ReleaseObject: not releasing because the reference count is already at 0");
 		}
-		
-		theAnswer = theIterator->mReferenceCount;
+	}
+	mGracePeriod.leave(theReader);
+	
+	//	removing the object from the map needs the mutex, which must not be taken as a reader
+	if(theIsLastReference)
+	{
+		CAMutex::Locker theLocker(mMutex);
+		theAnswer = _ReleaseLastReference(inObject);
 	}
 	
 	return theAnswer;
 }
 
-UInt64	SA_ObjectMap::_ReleaseObject(SA_Object* inObject)
+UInt64	SA_ObjectMap::_ReleaseLastReference(SA_Object* inObject)
 {
 	UInt64 theAnswer = 0;
-
-	//	find the info for this object
-	ObjectInfoList::iterator theIterator = std::find(mObjectInfoList.begin(), mObjectInfoList.end(), inObject);
-	if(theIterator != mObjectInfoList.end())
+	
+	//	the object may have been retained or unmapped since the count was seen at 1
+	ObjectInfo* theInfo = FindByObject(mIndex.load(), inObject);
+	if(theInfo != NULL)
 	{
-		//	don't underflow the reference count
-		if(theIterator->mReferenceCount > 0)
+		UInt64 theReferenceCount = theInfo->mReferenceCount.load();
+		while((theReferenceCount > 0) && !theInfo->mReferenceCount.compare_exchange_weak(theReferenceCount, theReferenceCount - 1))
 		{
-			//	decrement the reference count
-			theIterator->mReferenceCount -= 1;
+			//	retry with the count someone else just changed
+		}
+		
+		if(theReferenceCount == 1)
+		{
+			//	get rid of the info in the list, a count of 0 can't be retained anymore
+			mObjectInfoList.erase(std::find(mObjectInfoList.begin(), mObjectInfoList.end(), theInfo));
+			_PublishIndex();
+			delete theInfo;
 			
-			//	destroy the object if the count reaches 0
-			if(theIterator->mReferenceCount == 0)
+			//	and destroy the object
+			CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{ DestroyObject(inObject); });
+		}
+		else if(theReferenceCount > 1)
+		{
+			theAnswer = theReferenceCount - 1;
+		}
+	}
+	
+	return theAnswer;
+}
+
+void	SA_ObjectMap::_PublishIndex()
+{
+	//	Called with the mutex held after mObjectInfoList or an ID list changed. The lookups switch
+	//	to the new index, the old one is deleted once the readers that may use it are gone. The
+	//	object IDs are handed out in sequence, so they index an array directly.
+	ObjectIndex* theIndex = new ObjectIndex;
+	size_t theCapacity = 8;
+	while(theCapacity < (mObjectInfoList.size() * 2))
+	{
+		theCapacity <<= 1;
+	}
+	theIndex->mMask = theCapacity - 1;
+	theIndex->mByObject.assign(theCapacity, NULL);
+	
+	for(ObjectInfoList::iterator theIterator = mObjectInfoList.begin(); theIterator != mObjectInfoList.end(); ++theIterator)
+	{
+		ObjectInfo* theInfo = *theIterator;
+		for(ObjectIDList::iterator theIDIterator = theInfo->mObjectIDList.begin(); theIDIterator != theInfo->mObjectIDList.end(); ++theIDIterator)
+		{
+			if(*theIDIterator >= theIndex->mByObjectID.size())
 			{
-				//	get rid of the info in the list
-				mObjectInfoList.erase(theIterator);
-				
-				//	and destroy the object
-				CADispatchQueue::GetGlobalSerialQueue().Dispatch(false, ^{ DestroyObject(inObject); });
+				theIndex->mByObjectID.resize(*theIDIterator + 1, NULL);
 			}
+			theIndex->mByObjectID[*theIDIterator] = theInfo;
 		}
-		else
+		
+		size_t theSlot = HashObject(theInfo->mObject) & theIndex->mMask;
+		while(theIndex->mByObject[theSlot] != NULL)
 		{
-			DebugMsg("SA_ObjectMap::_ReleaseObject: not releasing because the reference count is already at 0");
+			theSlot = (theSlot + 1) & theIndex->mMask;
 		}
-		
-		theAnswer = theIterator->mReferenceCount;
+		theIndex->mByObject[theSlot] = theInfo;
 	}
 	
+	ObjectIndex* theOldIndex = mIndex.exchange(theIndex);
+	mGracePeriod.synchronize();
+	delete theOldIndex;
+}
+
+SA_ObjectMap::ObjectInfo*	SA_ObjectMap::FindByObjectID(const ObjectIndex* inIndex, AudioObjectID inObjectID)
+{
+	ObjectInfo* theAnswer = NULL;
+	if((inIndex != NULL) && (inObjectID < inIndex->mByObjectID.size()))
+	{
+		theAnswer = inIndex->mByObjectID[inObjectID];
+	}
 	return theAnswer;
 }
 
+SA_ObjectMap::ObjectInfo*	SA_ObjectMap::FindByObject(const ObjectIndex* inIndex, const SA_Object* inObject)
+{
+	ObjectInfo* theAnswer = NULL;
+	if(inIndex != NULL)
+	{
+		size_t theSlot = HashObject(inObject) & inIndex->mMask;
+		while((inIndex->mByObject[theSlot] != NULL) && (theAnswer == NULL))
+		{
+			if(inIndex->mByObject[theSlot]->mObject == inObject)
+			{
+				theAnswer = inIndex->mByObject[theSlot];
+			}
+			theSlot = (theSlot + 1) & inIndex->mMask;
+		}
+	}
+	return theAnswer;
+}
+
+bool	SA_ObjectMap::RetainInfo(ObjectInfo* inInfo, UInt64& outReferenceCount)
+{
+	//	a count of 0 means the object is on its way out, and the count must not overflow
+	UInt64 theReferenceCount = inInfo->mReferenceCount.load();
+	while((theReferenceCount > 0) && (theReferenceCount < UINT64_MAX) && !inInfo->mReferenceCount.compare_exchange_weak(theReferenceCount, theReferenceCount + 1))
+	{
+		//	retry with the count someone else just changed
+	}
+	
+	bool theAnswer = (theReferenceCount > 0) && (theReferenceCount < UINT64_MAX);
+	outReferenceCount = theAnswer ? (theReferenceCount + 1) : theReferenceCount;
+	if(theReferenceCount == UINT64_MAX)
+	{
+		DebugMsg("SA_ObjectMap::RetainInfo: not retaining because the reference count is at maximum");
+	}
+	return theAnswer;
+}
+
+size_t	SA_ObjectMap::HashObject(const SA_Object* inObject)
+{
+	UInt64 theHash = (reinterpret_cast<uintptr_t>(inObject) >> 4) * 0x9e3779b97f4a7c15ULL;
+	return static_cast<size_t>(theHash >> 32);
+}
+
 void	SA_ObjectMap::_Dump()
 {
 
@@ -497,11 +629,12 @@ void	SA_ObjectMap::_Dump()
 	
 	if(!mObjectInfoList.empty())
 	{
-		for(ObjectInfoList::iterator theIterator = mObjectInfoList.begin(); theIterator != mObjectInfoList.end(); ++theIterator)
+		for(ObjectInfoList::iterator theInfoIterator = mObjectInfoList.begin(); theInfoIterator != mObjectInfoList.end(); ++theInfoIterator)
 		{
+			ObjectInfo* theIterator = *theInfoIterator;
 			theBaseClassID = theIterator->mObject->GetBaseClassID();
 			theClassID = theIterator->mObject->GetClassID();
-			theReferenceCount = theIterator->mReferenceCount;
+			theReferenceCount = theIterator->mReferenceCount.load();
 			CACopy4CCToCString(theBaseClassIDString, theBaseClassID);
 			CACopy4CCToCString(theClassIDString, theClassID);
 			
@@ -56,11 +56,13 @@
 
 //	PublicUtility Includes
 #include "CAMutex.h"
+#include "GracePeriod.h"
 
 //	System Includes
 #include <CoreAudio/AudioServerPlugIn.h>
 
 //	Standard Library Includes
+#include <atomic>
 #include <vector>
 
 //==================================================================================================
@@ -195,6 +197,10 @@ protected:
 //		- Create the new object
 //		- Register the object with the map (via MapObject())
 //		- Activate the new object
+//
+//	Looking objects up and retaining/releasing them takes no lock. Those read an index that is
+//	rebuilt and swapped in by the mapping operations, which are serialized by the mutex, and use
+//	atomic reference counts. Only dropping the last reference to an object takes the mutex.
 //==================================================================================================
 
 class SA_ObjectMap
@@ -232,6 +238,15 @@ private:
 	UInt64								_RetainObject(SA_Object* inObject);
 	UInt64								_ReleaseObject(SA_Object* inObject);
 	void								_Dump();	
+	
+	struct ObjectInfo;
+	struct ObjectIndex;
+	void								_PublishIndex();
+	UInt64								_ReleaseLastReference(SA_Object* inObject);
+	static ObjectInfo*					FindByObjectID(const ObjectIndex* inIndex, AudioObjectID inObjectID);
+	static ObjectInfo*					FindByObject(const ObjectIndex* inIndex, const SA_Object* inObject);
+	static bool							RetainInfo(ObjectInfo* inInfo, UInt64& outReferenceCount);
+	static size_t						HashObject(const SA_Object* inObject);
 
 #pragma mark Implemenatation
 private:
@@ -239,18 +254,26 @@ private:
 	struct ObjectInfo
 	{
 		SA_Object*						mObject;
-		UInt64							mReferenceCount;
-		ObjectIDList					mObjectIDList;
+		std::atomic<UInt64>				mReferenceCount;
+		ObjectIDList					mObjectIDList;		//	only used with the mutex held
 
 										ObjectInfo(AudioObjectID inObjectID, SA_Object* inObject)	: mObject(inObject), mReferenceCount(1), mObjectIDList(1, inObjectID) {}
-		bool							operator==(AudioObjectID inObjectID) const					{ return std::find(mObjectIDList.begin(), mObjectIDList.end(), inObjectID) != mObjectIDList.end(); }
-		bool							operator==(const SA_Object* inObject) const					{ return mObject == inObject; }
 	};
-	typedef std::vector<ObjectInfo>		ObjectInfoList;
+	typedef std::vector<ObjectInfo*>	ObjectInfoList;
+	
+	//	immutable once published, read without the mutex
+	struct ObjectIndex
+	{
+		ObjectInfoList					mByObjectID;		//	indexed by AudioObjectID
+		ObjectInfoList					mByObject;			//	open addressing, keyed by the object pointer
+		size_t							mMask;
+	};
 	
 	CAMutex								mMutex;
 	AudioObjectID						mNextObjectID;
 	ObjectInfoList						mObjectInfoList;
+	std::atomic<ObjectIndex*>			mIndex;
+	GracePeriod							mGracePeriod;
 	
 	static pthread_once_t				sStaticInitializer;
 	static SA_ObjectMap*				sInstance;
@@ -75,7 +75,10 @@ SA_PlugIn&	SA_PlugIn::GetInstance()
 SA_PlugIn::SA_PlugIn()
 :
 	SA_Object(kAudioObjectPlugInObject, kAudioPlugInClassID, kAudioObjectClassID, 0),
+	JackBridgeDriverIF(0),
 	mDeviceInfoList(),
+	mIsShmAttached(false),
+	mDeviceListTimer(NULL),
 	mMutex("SA_PlugIn")
 {
 }
@@ -86,8 +89,11 @@ SA_PlugIn::~SA_PlugIn()
 
 void	SA_PlugIn::Activate()
 {
-	//_StartDeviceListNotifications();
-    _CreateDevices(1);
+	//	the daemon announces its devices in the registers of the first instance, without the shm
+	//	there is just the one device
+	mIsShmAttached = (create_shm() >= 0) && (attach_shm() >= 0);
+	UpdateDevices();
+	_StartDeviceListNotifications();
 	SA_Object::Activate();
 }
 
@@ -95,7 +101,7 @@ void	SA_PlugIn::Deactivate()
 {
 	CAMutex::Locker theLocker(mMutex);
 	SA_Object::Deactivate();
-	//_StopDeviceListNotifications();
+	_StopDeviceListNotifications();
 	_RemoveAllDevices();
 }
 
@@ -225,6 +231,27 @@ void	SA_PlugIn::GetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, con
 			//	has the UID.
 			ThrowIf(inQualifierDataSize < sizeof(CFStringRef), CAException(kAudioHardwareBadPropertySizeError), "SA_PlugIn::GetPropertyData: the qualifier size is too small for kAudioPlugInPropertyTranslateUIDToDevice");
 			ThrowIf(inDataSize < sizeof(AudioObjectID), CAException(kAudioHardwareBadPropertySizeError), "SA_PlugIn::GetPropertyData: not enough space for the return value of kAudioPlugInPropertyTranslateUIDToDevice");
+			{
+				CFStringRef theUID = *reinterpret_cast<const CFStringRef*>(inQualifierData);
+				AudioObjectID theDeviceObjectID = kAudioObjectUnknown;
+				
+				//	ask every device for its UID, they are numbered by instance
+				CAMutex::Locker theLocker(mMutex);
+				for(DeviceInfoList::const_iterator theDeviceIterator = mDeviceInfoList.begin(); (theDeviceObjectID == kAudioObjectUnknown) && (theDeviceIterator != mDeviceInfoList.end()); ++theDeviceIterator)
+				{
+					SA_ObjectReleaser<SA_Device> theDevice(SA_ObjectMap::CopyObjectOfClassByObjectID<SA_Device>(theDeviceIterator->mDeviceObjectID));
+					if(theDevice.IsValid())
+					{
+						CFStringRef theDeviceUID = theDevice->CopyDeviceUID();
+						if((theUID != NULL) && CFEqual(theDeviceUID, theUID))
+						{
+							theDeviceObjectID = theDeviceIterator->mDeviceObjectID;
+						}
+						CFRelease(theDeviceUID);
+					}
+				}
+				*reinterpret_cast<AudioObjectID*>(outData) = theDeviceObjectID;
+			}
 			outDataSize = sizeof(AudioObjectID);
 			break;
 			
@@ -253,33 +280,140 @@ void	SA_PlugIn::SetPropertyData(AudioObjectID inObjectID, pid_t inClientPID, con
 	};
 }
 
-void    SA_PlugIn:: _CreateDevices(UInt32 numDevices)
+void	SA_PlugIn::_StartDeviceListNotifications()
+{
+	//	the daemon may come and go with any number of instances, so the shm is polled. The
+	//	devices measure their latency with the same timer.
+	if(mIsShmAttached && (mDeviceListTimer == NULL))
+	{
+		mDeviceListTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
+		if(mDeviceListTimer != NULL)
+		{
+			dispatch_source_set_timer(mDeviceListTimer, dispatch_time(DISPATCH_TIME_NOW, kDeviceListPollInterval), kDeviceListPollInterval, kDeviceListPollInterval / 10);
+			dispatch_source_set_event_handler(mDeviceListTimer, ^{
+																	if(IsActive())
+																	{
+																		UpdateDevices();
+																		UpdateLatencies();
+																	}
+																});
+			dispatch_resume(mDeviceListTimer);
+		}
+	}
+}
+
+void	SA_PlugIn::_StopDeviceListNotifications()
+{
+	if(mDeviceListTimer != NULL)
+	{
+		dispatch_source_cancel(mDeviceListTimer);
+		dispatch_release(mDeviceListTimer);
+		mDeviceListTimer = NULL;
+	}
+}
+
+void	SA_PlugIn::UpdateDevices()
+{
+	//	one device per instance of the daemon, with the channels it asked for
+	UInt32 theNumberDevices = mIsShmAttached ? num_devices() : 1;
+	bool theDeviceListChanged = false;
+	
+	//	get rid of the devices of the instances that are gone
+	{
+		CAMutex::Locker theLocker(mMutex);
+		DeviceInfoList::iterator theDeviceIterator = mDeviceInfoList.begin();
+		while(theDeviceIterator != mDeviceInfoList.end())
+		{
+			if(theDeviceIterator->mInstance >= theNumberDevices)
+			{
+				DestroyDevice(theDeviceIterator->mDeviceObjectID);
+				theDeviceIterator = mDeviceInfoList.erase(theDeviceIterator);
+				theDeviceListChanged = true;
+			}
+			else
+			{
+				++theDeviceIterator;
+			}
+		}
+	}
+	
+	//	and create the missing ones
+	for(UInt32 theInstance = 0; theInstance < theNumberDevices; ++theInstance)
+	{
+		bool theDeviceExists = false;
+		{
+			CAMutex::Locker theLocker(mMutex);
+			for(DeviceInfoList::iterator theDeviceIterator = mDeviceInfoList.begin(); theDeviceIterator != mDeviceInfoList.end(); ++theDeviceIterator)
+			{
+				theDeviceExists |= (theDeviceIterator->mInstance == theInstance);
+			}
+		}
+		if(!theDeviceExists)
+		{
+			theDeviceListChanged |= _CreateDevice(theInstance, mIsShmAttached ? device_channels(theInstance) : JB_DEFAULT_CHANNELS);
+		}
+	}
+	
+	//	tell the host about it
+	if(theDeviceListChanged)
+	{
+		AudioObjectPropertyAddress theChangedAddresses[] = { { kAudioPlugInPropertyDeviceList, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster }, { kAudioObjectPropertyOwnedObjects, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster } };
+		Host_PropertiesChanged(GetObjectID(), 2, theChangedAddresses);
+	}
+}
+
+void	SA_PlugIn::UpdateLatencies()
 {
-    syslog(LOG_WARNING, "JackBridge: creating devices in _CreateDevices().");
-	//	Note that we catch all exceptions here so that we can finish processing the items in the notification
+	//	the devices are updated without holding the plug-in's state lock
+	std::vector<AudioObjectID> theDeviceObjectIDs;
+	{
+		CAMutex::Locker theLocker(mMutex);
+		for(DeviceInfoList::iterator theDeviceIterator = mDeviceInfoList.begin(); theDeviceIterator != mDeviceInfoList.end(); ++theDeviceIterator)
+		{
+			theDeviceObjectIDs.push_back(theDeviceIterator->mDeviceObjectID);
+		}
+	}
+	
+	for(std::vector<AudioObjectID>::iterator theIterator = theDeviceObjectIDs.begin(); theIterator != theDeviceObjectIDs.end(); ++theIterator)
+	{
+		CATry;
+		SA_ObjectReleaser<SA_Device> theDevice(SA_ObjectMap::CopyObjectOfClassByObjectID<SA_Device>(*theIterator));
+		if(theDevice.IsValid())
+		{
+			theDevice->UpdateLatency();
+		}
+		CACatch;
+	}
+}
+
+bool	SA_PlugIn::_CreateDevice(UInt32 inInstance, UInt32 inChannelsPerFrame)
+{
+    syslog(LOG_WARNING, "JackBridge: creating device #%d in _CreateDevice().", (int)inInstance);
+	//	Note that we catch all exceptions here so that a device that fails doesn't keep the others from being created
+	bool theAnswer = false;
 	SA_Device* theNewDevice = NULL;
-    for(UInt32 i=0; i<numDevices; i++) {
-        try
-        {
-            //	make the new device object
-            AudioObjectID theNewDeviceObjectID = SA_ObjectMap::GetNextObjectID();
-            theNewDevice = new SA_Device(theNewDeviceObjectID, i);
-            
-            //	add it to the object map
-            SA_ObjectMap::MapObject(theNewDeviceObjectID, theNewDevice);
-            
-            //	add it to the device list
-            AddDevice(theNewDevice);
-            
-            //	activate the device
-            theNewDevice->Activate();
-        }
-        catch(...)
-        {
-            RemoveDevice(theNewDevice);
-            SA_ObjectMap::ReleaseObject(theNewDevice);
-        }
-    }
+	try
+	{
+		//	make the new device object
+		AudioObjectID theNewDeviceObjectID = SA_ObjectMap::GetNextObjectID();
+		theNewDevice = new SA_Device(theNewDeviceObjectID, inInstance, inChannelsPerFrame);
+		
+		//	add it to the object map
+		SA_ObjectMap::MapObject(theNewDeviceObjectID, theNewDevice);
+		
+		//	add it to the device list
+		AddDevice(theNewDevice);
+		
+		//	activate the device
+		theNewDevice->Activate();
+		theAnswer = true;
+	}
+	catch(...)
+	{
+		RemoveDevice(theNewDevice);
+		SA_ObjectMap::ReleaseObject(theNewDevice);
+	}
+	return theAnswer;
 }
 
 void	SA_PlugIn::AddDevice(SA_Device* inDevice)
@@ -299,7 +433,7 @@ void	SA_PlugIn::_AddDevice(SA_Device* inDevice)
 	if(inDevice != NULL)
 	{
 		//  Initialize an DeviceInfo to describe the new device
-		DeviceInfo theDeviceInfo(inDevice->GetObjectID());
+		DeviceInfo theDeviceInfo(inDevice->GetObjectID(), inDevice->GetInstance());
 
 		//  put the device info in the list
 		mDeviceInfoList.push_back(theDeviceInfo);
@@ -341,23 +475,28 @@ void	SA_PlugIn::_RemoveAllDevices()
 		theDeviceIterator->mDeviceObjectID = 0;
 		
 		//	asynchronously get rid of the device since we are holding the plug-in's state lock
-		CADispatchQueue::GetGlobalSerialQueue().Dispatch(false,	^{
-																	CATry;
-																	//	resolve the device ID to an object
-																	SA_ObjectReleaser<SA_Device> theDeadDevice(SA_ObjectMap::CopyObjectOfClassByObjectID<SA_Device>(theDeadDeviceObjectID));
-																	if(theDeadDevice.IsValid())
-																	{
-																		//	deactivate the device
-																		theDeadDevice->Deactivate();
-																		
-																		//	and release it
-																		SA_ObjectMap::ReleaseObject(theDeadDevice);
-																	}
-																	CACatch;
-																});
+		DestroyDevice(theDeadDeviceObjectID);
 	}
 }
 
+void	SA_PlugIn::DestroyDevice(AudioObjectID inDeviceObjectID)
+{
+	CADispatchQueue::GetGlobalSerialQueue().Dispatch(false,	^{
+																CATry;
+																//	resolve the device ID to an object
+																SA_ObjectReleaser<SA_Device> theDeadDevice(SA_ObjectMap::CopyObjectOfClassByObjectID<SA_Device>(inDeviceObjectID));
+																if(theDeadDevice.IsValid())
+																{
+																	//	deactivate the device
+																	theDeadDevice->Deactivate();
+																	
+																	//	and release it
+																	SA_ObjectMap::ReleaseObject(theDeadDevice);
+																}
+																CACatch;
+															});
+}
+
 pthread_once_t				SA_PlugIn::sStaticInitializer = PTHREAD_ONCE_INIT;
 SA_PlugIn*					SA_PlugIn::sInstance = NULL;
 AudioServerPlugInHostRef	SA_PlugIn::sHost = NULL;
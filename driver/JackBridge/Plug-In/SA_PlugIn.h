@@ -63,6 +63,11 @@
 //	PublicUtility Includes
 #include "CADispatchQueue.h"
 
+//	System Includes
+#include <dispatch/dispatch.h>
+
+#include "JackBridge.h"
+
 //==================================================================================================
 //	Types
 //==================================================================================================
@@ -75,7 +80,7 @@ class	SA_Device;
 
 class SA_PlugIn
 :
-	public SA_Object
+	public SA_Object, JackBridgeDriverIF
 {
 
 #pragma mark Construction/Destruction
@@ -102,9 +107,12 @@ public:
 
 #pragma mark Device List Management
 private:
-	//void							_StartDeviceListNotifications();
-	//void							_StopDeviceListNotifications();
-	void							_CreateDevices(UInt32 deviceNum);
+	void							_StartDeviceListNotifications();
+	void							_StopDeviceListNotifications();
+	void							UpdateDevices();
+	void							UpdateLatencies();
+	bool							_CreateDevice(UInt32 inInstance, UInt32 inChannelsPerFrame);
+	static void						DestroyDevice(AudioObjectID inDeviceObjectID);
 	
 	void							AddDevice(SA_Device* inDevice);
 	void							RemoveDevice(SA_Device* inDevice);
@@ -119,13 +127,19 @@ private:
 	struct							DeviceInfo
 	{
 		AudioObjectID				mDeviceObjectID;
+		UInt32						mInstance;	//	shm slot of the device
 		
-									DeviceInfo() : mDeviceObjectID(0) {}
-									DeviceInfo(AudioObjectID inDeviceObjectID) : mDeviceObjectID(inDeviceObjectID) {}
+									DeviceInfo() : mDeviceObjectID(0), mInstance(0) {}
+									DeviceInfo(AudioObjectID inDeviceObjectID, UInt32 inInstance) : mDeviceObjectID(inDeviceObjectID), mInstance(inInstance) {}
 	};
 	typedef std::vector<DeviceInfo>	DeviceInfoList;
 	
 	DeviceInfoList					mDeviceInfoList;
+	
+	//	the devices follow the number of instances the daemon announces in the shm, which is
+	//	polled with this timer
+	bool							mIsShmAttached;
+	dispatch_source_t				mDeviceListTimer;
 
 #pragma mark Host Accesss
 public:
@@ -135,6 +149,8 @@ public:
 	static void						Host_RequestDeviceConfigurationChange(AudioObjectID inDeviceObjectID, UInt64 inChangeAction, void* inChangeInfo)			{ if(sHost != NULL) { sHost->RequestDeviceConfigurationChange(GetInstance().sHost, inDeviceObjectID, inChangeAction, inChangeInfo); } }
 
 #pragma mark Implementation
+#define kDeviceListPollInterval		(1 * NSEC_PER_SEC)
+
 private:
 	CAMutex							mMutex;
 	
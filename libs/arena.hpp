@@ -0,0 +1,167 @@
+/*
+MIT License
+
+Copyright (c) 2016-2018 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef __ARENA_HPP__
+#define __ARENA_HPP__
+
+#define ARENA_ALIGN         64                  // cache line, enough for any SIMD load
+#define ARENA_DEFAULT_SIZE  (256*1024*1024)     // address space reserved by init()
+
+/**********************************************************************
+ Startup arena
+
+ All buffers of the daemon are carved from one aligned region reserved
+ by init(). seal() locks the used part into memory, gives the rest back
+ and from then on any further allocation is a fatal error, so nothing can
+ allocate in steady state. Memory is only returned as a whole at exit.
+
+ Code shared with other programs calls arena_alloc()/arena_free(), which
+ fall back to the heap until Arena::global().init() has been called.
+**********************************************************************/
+class Arena {
+public:
+    static Arena& global() {
+        static Arena arena;
+        return arena;
+    }
+
+    bool init(size_t size = ARENA_DEFAULT_SIZE) {
+        void* p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "Arena: mmap() of %zu bytes failed\n", size);
+            return false;
+        }
+        base = (char*)p;
+        capacity = size;
+        used = 0;
+        count = 0;
+        return true;
+    }
+
+    bool active() const {
+        return (base != NULL);
+    }
+
+    bool contains(const void* p) const {
+        return (base != NULL) && ((const char*)p >= base) && ((const char*)p < base + capacity);
+    }
+
+    void* alloc(size_t size, size_t align = ARENA_ALIGN) {
+        if (sealed) {
+            fprintf(stderr, "Arena: allocation of %zu bytes after seal()\n", size);
+            abort();
+        }
+        if (align < ARENA_ALIGN) {
+            align = ARENA_ALIGN;
+        }
+        size_t offset = (used + align - 1) & ~(align - 1);
+        if (offset + size > capacity) {
+            fprintf(stderr, "Arena: out of memory (%zu + %zu bytes)\n", offset, size);
+            return NULL;
+        }
+        used = offset + size;
+        count++;
+        return base + offset;
+    }
+
+    // Locks the used part and forbids further allocations
+    void seal() {
+        size_t page = getpagesize();
+        size_t locked = (used + page - 1) & ~(page - 1);
+        if (locked < capacity) {
+            munmap(base + locked, capacity - locked);
+            capacity = locked;
+        }
+        isLocked = (locked == 0) || (mlock(base, locked) == 0);
+        sealed = true;
+    }
+
+    void report(FILE* fp) const {
+        fprintf(fp, "Arena: %zu bytes in %d buffers (%s)\n", used, count,
+                sealed ? (isLocked ? "locked" : "NOT locked") : "not sealed");
+    }
+
+    size_t footprint() const {
+        return used;
+    }
+
+private:
+    char*  base;
+    size_t capacity, used;
+    int    count;
+    bool   sealed, isLocked;
+
+    Arena() : base(NULL), capacity(0), used(0), count(0), sealed(false), isLocked(false) {
+    }
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+};
+
+static inline void* arena_alloc(size_t size, size_t align = ARENA_ALIGN) {
+    Arena& arena = Arena::global();
+    if (arena.active()) {
+        return arena.alloc(size, align);
+    }
+    void* p = NULL;
+    if (posix_memalign(&p, (align < sizeof(void*)) ? sizeof(void*) : align, size ? size : 1) != 0) {
+        return NULL;
+    }
+    return p;
+}
+
+static inline void arena_free(void* p) {
+    if ((p != NULL) && !Arena::global().contains(p)) {
+        free(p);
+    }
+}
+
+template <typename T>
+static inline T* arena_new_array(size_t n) {
+    T* p = (T*)arena_alloc(sizeof(T)*n);
+    if (p != NULL) {
+        for (size_t i=0; i<n; i++) {
+            new (&p[i]) T();
+        }
+    }
+    return p;
+}
+
+template <typename T>
+static inline void arena_delete_array(T* p, size_t n) {
+    if (p != NULL) {
+        for (size_t i=0; i<n; i++) {
+            p[i].~T();
+        }
+        arena_free(p);
+    }
+}
+#endif
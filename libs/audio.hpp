@@ -1,111 +1,299 @@
-/*
-MIT License
-
-Copyright (c) 2016 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in all
-copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
-SOFTWARE.
-*/
-
-#include <iostream>
-#include <cstdlib>
-#include <unistd.h>
-#include <string>
-#include <sstream>
-#include <jack/jack.h>
-
-#ifndef __AUDIO_HPP__
-#define __AUDIO_HPP__
-typedef jack_default_audio_sample_t sample_t;
-
-class audioFormat {
-public:
-    int SampleRate;
-    int bitsPerSample;
-    int SamplesPerFrame;
-};
-
-#define MAX_FRAME_SIZE 4096
-#define STR_BUFSZ (MAX_FRAME_SIZE*sizeof(sample_t)*4) // 4buffers
-#define MAX_DELAY 1024
-#define MAX_CHANNELS 256
-#define BUFNUM          (MAX_FRAME_SIZE*4) // 4buffers
-
-class audioStream {
-private:
-    sample_t *buf;
-    unsigned short wptr;
-    unsigned short rptr;
-
-public:
-    audioStream() {
-        buf = (sample_t*)malloc(STR_BUFSZ);
-        wptr = rptr = 0;
-    }
-
-    ~audioStream() {
-        free(buf);
-    }
-
-    int dataAvailable(int nframes) {
-        int diff;
-        
-        diff = (wptr-rptr) & (BUFNUM-1);
-        if (diff < nframes) {
-            return 0;
-        }
-        if (diff > MAX_DELAY) {
-            rptr = ((wptr - nframes) & ~(nframes - 1)) & (BUFNUM-1);
-        }
-        return 1;
-    }
-
-    int sendToStream(sample_t* in, int nframes) {
-        for(int i=0; i<nframes; i++) {
-            *(buf+wptr) = in[i];
-            wptr = (wptr+1)&(BUFNUM-1);
-        }
-        return nframes;
-    }
-
-    int receiveFromStream(sample_t* out, int nframes) {
-        if (dataAvailable(nframes)) {
-            for (int i=0; i<nframes; i++) {
-                out[i] = *(buf+rptr);
-                rptr = (rptr+1)&(BUFNUM-1);
-            }
-            return nframes;
-        }
-        return 0;
-    }
-    
-    void sendData(sample_t data) {
-        *(buf+wptr) = data;
-        wptr = (wptr+1)&(BUFNUM-1);
-        return;
-    }
-
-    sample_t receiveData() {
-        sample_t data;
-
-        data = *(buf+rptr);
-        rptr = (rptr+1)&(BUFNUM-1);
-        return data;
-    }
-};
-#endif
+/*
+MIT License
+
+Copyright (c) 2016 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include <string>
+#include <sstream>
+#include <jack/jack.h>
+#include "ringBuffer.hpp"
+
+#ifndef __AUDIO_HPP__
+#define __AUDIO_HPP__
+typedef jack_default_audio_sample_t sample_t;
+
+class audioFormat {
+public:
+    int SampleRate;
+    int bitsPerSample;
+    int SamplesPerFrame;
+};
+
+#define MAX_FRAME_SIZE 4096
+#define STR_BUFSZ (MAX_FRAME_SIZE*sizeof(sample_t)*4) // 4buffers
+#define MAX_DELAY 1024
+#define MAX_CHANNELS 256
+#define BUFNUM          (MAX_FRAME_SIZE*4) // 4buffers
+
+#define CATCHUP_PERIODS 16 // default time to reach the latency target
+#define CATCHUP_MAX_DRIFT 128 // default: catch-up reads at most 1/128 (0.8%) faster than it plays
+
+/******************************************************************************
+ Latency catch-up
+
+ Once the fill level of a stream exceeds the limit, the excess over the
+ target is drained over a number of periods by reading slightly more
+ frames than are played and resampling them linearly into the period.
+ The drain rate is fixed when catch-up starts so that the target is reached
+ within 'periods' periods, but reading never runs more than 1/maxDrift
+ faster than playing, which keeps the pitch change inaudible. The catch-up
+ therefore ends within max(periods, ceil(excess*maxDrift/nframes)) periods; with
+ the default CATCHUP_MAX_DRIFT a 2048 frame excess at 256 frames/period
+ takes 1024 periods. Fractions of a frame are carried over to the next
+ period, so the rate holds for short periods as well.
+******************************************************************************/
+class latencyCatchUp {
+public:
+    latencyCatchUp() : target(0), limit(MAX_DELAY), periods(CATCHUP_PERIODS), drift(CATCHUP_MAX_DRIFT),
+                       rate(0), credit(0) {
+    }
+
+    // target: fill level to go back to (0: one period), limit: fill level to
+    // start catch-up at, periods: number of periods to get there unless that
+    // needs reading more than 1/maxDrift faster (1: up to twice as fast).
+    void configure(int _target, int _limit, int _periods, int maxDrift = CATCHUP_MAX_DRIFT) {
+        target = (_target > 0) ? _target : 0;
+        limit = (_limit > 0) ? _limit : MAX_DELAY;
+        periods = (_periods > 0) ? _periods : 1;
+        drift = (maxDrift > 0) ? maxDrift : 1;
+        rate = credit = 0;
+    }
+
+    // Periods configure() takes to drain 'excess' frames at nframes/period
+    int catchUpPeriods(size_t excess, int nframes) const {
+        size_t r = (excess*drift + periods - 1) / periods;
+        if (r > (size_t)nframes) {
+            r = nframes;
+        }
+        return (r > 0) ? (int)((excess*drift + r - 1) / r) : 0;
+    }
+
+    // Number of frames to drop in addition to nframes in this period
+    int extraFrames(size_t fill, int nframes) {
+        size_t goal = (target ? target : nframes) + nframes;
+        if (fill <= goal) {
+            rate = credit = 0;
+            return 0;
+        }
+        size_t excess = fill - goal;
+        if ((rate == 0) && (fill <= limit)) {
+            return 0;
+        }
+        // in 1/drift frames per period, at most nframes of them
+        size_t r = (excess*drift + periods - 1) / periods;
+        if (r > rate) {
+            rate = (r < (size_t)nframes) ? r : nframes;
+        }
+        credit += rate;
+        size_t e = credit / drift;
+        credit -= e*drift;
+        return (int)((excess < e) ? excess : e);
+    }
+
+    // Resamples (nframes+extra+1) frames of 'channels' interleaved samples
+    // into nframes frames of planar out[]. The last input frame is only
+    // used for interpolation, the next period starts right at it.
+    static void resample(const sample_t* in, int channels, sample_t** out, int nframes, int extra) {
+        uint64_t step = ((uint64_t)(nframes + extra) << 32) / nframes;
+        uint64_t pos = 0;
+        for(int i=0; i<nframes; i++, pos+=step) {
+            const sample_t* p = in + (pos >> 32)*channels;
+            sample_t frac = (sample_t)(pos & 0xffffffff) * (sample_t)(1.0/4294967296.0);
+            for(int c=0; c<channels; c++) {
+                out[c][i] = p[c] + frac*(p[c+channels] - p[c]);
+            }
+        }
+    }
+
+private:
+    size_t target, limit;
+    int periods;
+    size_t drift;
+    size_t rate, credit;
+};
+
+class audioStream {
+private:
+    RingBuffer<sample_t, BUFNUM> ring;
+    latencyCatchUp catchUp;
+    sample_t scratch[MAX_FRAME_SIZE*2+1];
+
+public:
+    // See latencyCatchUp::configure()
+    void setLatency(int target, int limit, int periods, int maxDrift = CATCHUP_MAX_DRIFT) {
+        catchUp.configure(target, limit, periods, maxDrift);
+    }
+
+    int dataAvailable(int nframes) {
+        return (ring.readable() >= (size_t)nframes);
+    }
+
+    int framesAvailable() {
+        return ring.readable();
+    }
+
+    int sendToStream(sample_t* in, int nframes) {
+        return ring.write(in, nframes);
+    }
+
+    int receiveFromStream(sample_t* out, int nframes) {
+        size_t fill = ring.readable();
+        if (fill < (size_t)nframes) {
+            return 0;
+        }
+        int extra = catchUp.extraFrames(fill, nframes);
+        if (extra == 0) {
+            return ring.read(out, nframes);
+        }
+
+        ringBufferView<sample_t> v = ring.peek(nframes + extra + 1);
+        memcpy(scratch, v.data[0], v.len[0]*sizeof(sample_t));
+        memcpy(scratch + v.len[0], v.data[1], v.len[1]*sizeof(sample_t));
+        if (v.size() == (size_t)(nframes + extra)) {
+            scratch[v.size()] = scratch[v.size()-1];
+        }
+        ring.consume(nframes + extra);
+        latencyCatchUp::resample(scratch, 1, &out, nframes, extra);
+        return nframes;
+    }
+    
+    void sendData(sample_t data) {
+        ring.write(&data, 1);
+        return;
+    }
+
+    sample_t receiveData() {
+        sample_t data = 0;
+
+        ring.read(&data, 1);
+        return data;
+    }
+};
+/******************************************************************************
+ Multi-channel stream
+
+ Stores whole interleaved frames, so a period of all channels is published
+ with a single counter update and the channels can never drift apart.
+******************************************************************************/
+template <int Channels, size_t Frames = BUFNUM>
+class multiChannelStream {
+public:
+    typedef struct {
+        sample_t s[Channels];
+    } frame_t;
+
+private:
+    RingBuffer<frame_t, Frames> ring;
+    latencyCatchUp catchUp;
+    frame_t* scratch;
+
+public:
+    multiChannelStream() {
+        scratch = (frame_t*)arena_alloc(sizeof(frame_t)*(MAX_FRAME_SIZE*2+1));
+    }
+
+    ~multiChannelStream() {
+        arena_free(scratch);
+    }
+
+    // See latencyCatchUp::configure()
+    void setLatency(int target, int limit, int periods, int maxDrift = CATCHUP_MAX_DRIFT) {
+        catchUp.configure(target, limit, periods, maxDrift);
+    }
+
+    int dataAvailable(int nframes) {
+        return (ring.readable() >= (size_t)nframes);
+    }
+
+    int framesAvailable() {
+        return ring.readable();
+    }
+
+    // in[c] is channel c. The whole period is dropped if it doesn't fit.
+    int sendToStream(sample_t** in, int nframes) {
+        ringBufferView<frame_t> v = ring.reserve(nframes);
+        if (v.size() < (size_t)nframes) {
+            return 0;
+        }
+        int i = 0;
+        for(int seg=0; seg<2; seg++) {
+            frame_t* f = v.data[seg];
+            for(size_t j=0; j<v.len[seg]; j++, i++) {
+                for(int c=0; c<Channels; c++) {
+                    f[j].s[c] = in[c][i];
+                }
+            }
+        }
+        ring.commit(nframes);
+        return nframes;
+    }
+
+    int receiveFromStream(sample_t** out, int nframes) {
+        size_t fill = ring.readable();
+        if (fill < (size_t)nframes) {
+            return 0;
+        }
+        int extra = catchUp.extraFrames(fill, nframes);
+        ringBufferView<frame_t> v = ring.peek(nframes + extra + (extra ? 1 : 0));
+        if (extra == 0) {
+            int i = 0;
+            for(int seg=0; seg<2; seg++) {
+                const frame_t* f = v.data[seg];
+                for(size_t j=0; j<v.len[seg]; j++, i++) {
+                    for(int c=0; c<Channels; c++) {
+                        out[c][i] = f[j].s[c];
+                    }
+                }
+            }
+        } else {
+            memcpy(scratch, v.data[0], v.len[0]*sizeof(frame_t));
+            memcpy(scratch + v.len[0], v.data[1], v.len[1]*sizeof(frame_t));
+            if (v.size() == (size_t)(nframes + extra)) {
+                scratch[v.size()] = scratch[v.size()-1];
+            }
+            latencyCatchUp::resample(scratch[0].s, Channels, out, nframes, extra);
+        }
+        ring.consume(nframes + extra);
+        return nframes;
+    }
+
+    // Zero-copy access to interleaved frames, see RingBuffer
+    ringBufferView<frame_t> reserve(size_t nframes) {
+        return ring.reserve(nframes);
+    }
+
+    void commit(size_t nframes) {
+        ring.commit(nframes);
+    }
+
+    ringBufferView<frame_t> peek(size_t nframes) {
+        return ring.peek(nframes);
+    }
+
+    void consume(size_t nframes) {
+        ring.consume(nframes);
+    }
+};
+#endif
@@ -24,6 +24,8 @@ SOFTWARE.
 
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <atomic>
 #include <unistd.h>
 #include <string>
 #include <sstream>
@@ -33,6 +35,8 @@ SOFTWARE.
 #include <errno.h>
 #include <sys/stat.h>
 #include "audio.hpp"
+#include "ringBuffer.hpp"
+#include <stdint.h>
 
 #ifndef __COREAUDIO_HPP__
 #define __COREAUDIO_HPP__
@@ -42,21 +46,54 @@ SOFTWARE.
 ******************************************************************************/
 //
 // Shared memory map:
-// 0x0000          : Control Registers (Read/Write Pointers)
+// 0x0000          : Control Registers (16 bit Read/Write Pointers)
+// 0x0040          : Extended header (64 bit frame counters, optional)
 // 0x1000          : Upstream buffer (Driver -> Application)
 // 0x1000+STRBUFSZ : Downstream buffer (Application -> Driver)
 //
+// The 16 bit pointers count samples modulo STRBUFNUM. When the extended
+// header is present (see format_shm()), the rings may be of any power of 2
+// size and positions are free running 64 bit frame counters. The counters
+// are authoritative and only the side moving a pointer writes it. With the
+// legacy ring size the 16 bit pointers are mirrored from the counters, and
+// a pointer whose owner has not claimed it in the header (a legacy client)
+// is followed through its 16 bit value instead, so old and new clients can
+// share one shm.
+//
 #define AUDIO_SAMPLE_SIZE (sizeof(sample_t))
 
 #define STRBUFNUM           (MAX_FRAME_SIZE*4*2) // stereo * 4buffers
 #define STRBUFSZ            (STRBUFNUM*AUDIO_SAMPLE_SIZE) // 4buffers * stereo
 #define JACK_SHMSIZE        (0x1000+STRBUFSZ*2) // control + down/upstream buffers
 
+#define COREAUDIO_SHM_HEADER    0x0040
+#define COREAUDIO_SHM_MAGIC     0x4a525831 // "JRX1"
+#define COREAUDIO_SHM_VERSION   2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t channels;      // samples per frame (2)
+    uint32_t ringFrames;    // frames per ring, power of 2
+    volatile uint64_t frames[4]; // same order as the 16 bit pointers
+    volatile uint32_t owned[4];  // set while a new client moves the pointer
+} coreAudioShmHeader_t;
+
 class coreAudioStream {
 private:
-    sample_t *buf;
+    enum { UP_WRITE = 0, UP_READ, DOWN_WRITE, DOWN_READ };
+
+    latencyCatchUp upCatchUp, downCatchUp;
+    sample_t scratch[(MAX_FRAME_SIZE*2+1)*2];
+
     int shm_fd;
-    unsigned short *uwp, *urp, *dwp, *drp;
+    // positions are read once and published once per call
+    volatile unsigned short *legacy;    // uwp, urp, dwp, drp
+    coreAudioShmHeader_t *header;       // NULL with legacy shm
+    bool mirror;                        // keep the 16 bit pointers too
+    unsigned int claimed;               // pointers this stream moves
+    uint64_t follow[4];                 // legacy owned pointers, in samples
+    size_t ringSamples;
     sample_t *buf_up;
     sample_t *buf_down;
 
@@ -78,53 +115,141 @@ private:
                 return -1;
             }
         }
-            
-        char* shm_base = (char*)mmap(NULL, JACK_SHMSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+        size_t size = ((size_t)stat.st_size > JACK_SHMSIZE) ? (size_t)stat.st_size : JACK_SHMSIZE;
+        char* shm_base = (char*)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, shm_fd, 0);
         if (shm_base == MAP_FAILED) {
             fprintf(stderr, "mmap() failed with %s\n", strerror(errno));
             return -1;
         }
 
-        uwp = (unsigned short*)shm_base;
-        urp = ((unsigned short*)shm_base)+1;
-        dwp = ((unsigned short*)shm_base)+2;
-        drp = ((unsigned short*)shm_base)+3;
+        legacy = (volatile unsigned short*)shm_base;
+        header = (coreAudioShmHeader_t*)(shm_base + COREAUDIO_SHM_HEADER);
+        if ((header->magic == COREAUDIO_SHM_MAGIC) && (header->version == COREAUDIO_SHM_VERSION)
+            && (header->channels == 2) && (0x1000 + (size_t)header->ringFrames*2*2*AUDIO_SAMPLE_SIZE <= size)) {
+            ringSamples = (size_t)header->ringFrames*2;
+            mirror = (ringSamples == STRBUFNUM);
+            for(int i=0; i<4; i++) {
+                follow[i] = header->frames[i]*2;
+            }
+        } else {
+            header = NULL;
+            ringSamples = STRBUFNUM;
+            mirror = true;
+        }
         buf_up = (sample_t*)(shm_base + 0x1000);
-        buf_down = buf_up + STRBUFNUM;
+        buf_down = buf_up + ringSamples;
         return 0;
     }
 
-    int dataAvailableOnUpstream(int nframes) {
-        unsigned int diff;
-        static int ncalls=0;
+    // position (in samples) of one of the pointers
+    uint64_t position(int i) {
+        uint64_t pos;
+        if (header == NULL) {
+            pos = legacy[i];
+        } else if (!mirror || header->owned[i]) {
+            pos = header->frames[i]*2;
+            follow[i] = pos;
+        } else {
+            // moved by a legacy client, follow its 16 bit pointer locally
+            pos = follow[i] + ((legacy[i] - (unsigned int)follow[i]) & (STRBUFNUM-1));
+            follow[i] = pos;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return pos;
+    }
 
-        ncalls++;        
-        diff = (*uwp-*urp) & (STRBUFNUM-1);
-        if (diff < nframes*2) {
-            return 0;
+    // Only the side moving pointer i calls this. Readers use either the
+    // counter or the 16 bit pointer, never both, so the two stores need
+    // not be atomic together.
+    void publish(int i, uint64_t pos) {
+        std::atomic_thread_fence(std::memory_order_release);
+        if (header != NULL) {
+            header->frames[i] = pos/2;
         }
-        if (diff > MAX_DELAY*2) {
-            fprintf(stderr, "%d: WP: %d RP: %d\n", ncalls, *uwp, *urp);
-            *urp = ((*uwp - nframes*2) & ~(nframes*2 - 1)) & (STRBUFNUM-1);
+        if (mirror) {
+            legacy[i] = pos & (STRBUFNUM-1);
         }
-        return 1;
+        if ((header != NULL) && !(claimed & (1 << i))) {
+            // both agree now, readers may switch to the counter
+            std::atomic_thread_fence(std::memory_order_release);
+            header->owned[i] = 1;
+            claimed |= (1 << i);
+        }
+    }
+
+    // frames between two positions
+    size_t distance(uint64_t wp, uint64_t rp) const {
+        return ((header != NULL) ? (size_t)(wp - rp) : (size_t)((wp - rp) & (STRBUFNUM-1))) / 2;
+    }
+
+    ringBufferView<sample_t> segments(sample_t* base, uint64_t pos, size_t n) const {
+        ringBufferView<sample_t> v;
+        size_t offset = (size_t)(pos & (ringSamples - 1));
+        size_t first = ringSamples - offset;
+        v.data[0] = base + offset;
+        v.len[0] = (n < first) ? n : first;
+        v.data[1] = base;
+        v.len[1] = n - v.len[0];
+        return v;
     }
 
-    int dataAvailableOnDownstream(int nframes) {
-        unsigned int diff;
-        
-        diff = (*dwp-*drp) & (STRBUFNUM-1);
-        if (diff < nframes*2) {
+    void interleave(sample_t* base, uint64_t pos, sample_t** in, int nframes) {
+        ringBufferView<sample_t> v = segments(base, pos, nframes*2);
+        int i = 0;
+        for(int s=0; s<2; s++) {
+            sample_t* p = v.data[s];
+            for(size_t j=0; j<v.len[s]; j+=2, i++) {
+                p[j] = in[0][i];
+                p[j+1] = in[1][i];
+            }
+        }
+    }
+
+    void deinterleave(sample_t* base, uint64_t pos, sample_t** out, int nframes) {
+        ringBufferView<sample_t> v = segments(base, pos, nframes*2);
+        int i = 0;
+        for(int s=0; s<2; s++) {
+            const sample_t* p = v.data[s];
+            for(size_t j=0; j<v.len[s]; j+=2, i++) {
+                out[0][i] = p[j];
+                out[1][i] = p[j+1];
+            }
+        }
+    }
+
+    // Reads nframes from a shm ring. Excess latency is drained smoothly
+    // by latencyCatchUp instead of jumping the read pointer.
+    int receive(sample_t* base, int w, int r, latencyCatchUp& catchUp, sample_t** out, int nframes) {
+        uint64_t wp = position(w);
+        uint64_t rp = position(r);
+        size_t fill = distance(wp, rp);
+        if (fill < (size_t)nframes) {
             return 0;
         }
-        if (diff > MAX_DELAY*2) {
-            *drp = ((*dwp - nframes*2) & ~(nframes*2 - 1)) & (STRBUFNUM-1);
+        int extra = catchUp.extraFrames(fill, nframes);
+        if (extra == 0) {
+            deinterleave(base, rp, out, nframes);
+        } else {
+            size_t n = nframes + extra + 1;
+            if (n > fill) {
+                n = fill;
+            }
+            ringBufferView<sample_t> v = segments(base, rp, n*2);
+            memcpy(scratch, v.data[0], v.len[0]*sizeof(sample_t));
+            memcpy(scratch + v.len[0], v.data[1], v.len[1]*sizeof(sample_t));
+            if (n == (size_t)(nframes + extra)) {
+                scratch[n*2] = scratch[n*2-2];
+                scratch[n*2+1] = scratch[n*2-1];
+            }
+            latencyCatchUp::resample(scratch, 2, out, nframes, extra);
         }
-        return 1;
+        publish(r, rp + (nframes+extra)*2);
+        return nframes;
     }
 
 public:
-    coreAudioStream(audioFormat inFormat) {
+    coreAudioStream(audioFormat inFormat) : legacy(NULL), header(NULL), mirror(true), claimed(0), ringSamples(STRBUFNUM) {
         if(attach_shm() < 0) {
             fprintf(stderr, "attach_shm() failed\n");
             return; 
@@ -132,55 +257,154 @@ public:
     }
 
     ~coreAudioStream() {
-        free(buf);
+        // hand the pointers back, a legacy client may move them next
+        for(int i=0; i<4; i++) {
+            if (claimed & (1 << i)) {
+                header->owned[i] = 0;
+            }
+        }
+    }
+
+    // Creates (or recreates) the shm with the extended header and rings of
+    // ringFrames stereo frames (power of 2). STRBUFNUM/2 frames keeps the
+    // layout usable by legacy clients.
+    static int format_shm(size_t ringFrames) {
+        if ((ringFrames == 0) || ((ringFrames & (ringFrames - 1)) != 0)) {
+            fprintf(stderr, "ring size must be a power of 2\n");
+            return -1;
+        }
+        size_t size = 0x1000 + ringFrames*2*2*AUDIO_SAMPLE_SIZE;
+        if (size < JACK_SHMSIZE) {
+            size = JACK_SHMSIZE;
+        }
+        int fd = shm_open("/jackrouter", O_CREAT|O_RDWR, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
+        if (fd < 0) {
+            fprintf(stderr, "shm_open() failed with %s\n", strerror(errno));
+            return -1;
+        }
+        if (ftruncate(fd, size) < 0) {
+            fprintf(stderr, "ftruncate() failed with %s\n", strerror(errno));
+            close(fd);
+            return -1;
+        }
+        char* shm_base = (char*)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (shm_base == MAP_FAILED) {
+            fprintf(stderr, "mmap() failed with %s\n", strerror(errno));
+            return -1;
+        }
+        memset(shm_base, 0, 0x1000);
+        coreAudioShmHeader_t* h = (coreAudioShmHeader_t*)(shm_base + COREAUDIO_SHM_HEADER);
+        h->version = COREAUDIO_SHM_VERSION;
+        h->channels = 2;
+        h->ringFrames = ringFrames;
+        std::atomic_thread_fence(std::memory_order_release);
+        h->magic = COREAUDIO_SHM_MAGIC;
+        munmap(shm_base, size);
+        return 0;
     }
 
     void reset() {
-        *uwp = *urp = *dwp = *drp = 0;
+        for(int i=0; i<4; i++) {
+            legacy[i] = 0;
+            follow[i] = 0;
+            if (header != NULL) {
+                header->frames[i] = 0;
+                header->owned[i] = 0;
+            }
+        }
+        claimed = 0;
+    }
+
+    // true when positions are exact 64 bit counters
+    bool isExtended() const {
+        return (header != NULL);
+    }
+
+    // Frames written but not read yet. Exact with the extended header,
+    // modulo the ring size with legacy shm.
+    int64_t upstreamLag() {
+        return distance(position(UP_WRITE), position(UP_READ));
+    }
+
+    int64_t downstreamLag() {
+        return distance(position(DOWN_WRITE), position(DOWN_READ));
+    }
+
+    // See latencyCatchUp::configure(), applies to both directions
+    void setLatency(int target, int limit, int periods, int maxDrift = CATCHUP_MAX_DRIFT) {
+        upCatchUp.configure(target, limit, periods, maxDrift);
+        downCatchUp.configure(target, limit, periods, maxDrift);
     }
 
     // To be fixed (Input is 32bit float stereo sigle stream)
     int sendToUpstream(sample_t** in, int nframes) {
-        for(int i=0; i<nframes; i++) {
-            *(buf_up+(*uwp)) = in[0][i];
-            *(buf_up+(*uwp)+1) = in[1][i];
-            *uwp = (*uwp+2)&(STRBUFNUM-1);
-        }
+        uint64_t wp = position(UP_WRITE);
+        interleave(buf_up, wp, in, nframes);
+        publish(UP_WRITE, wp + nframes*2);
         return nframes;
     }
 
+    // Bulk variant: in is already interleaved stereo, copied with memcpy
+    int sendToUpstream(const sample_t* in, int nframes) {
+        uint64_t wp = position(UP_WRITE);
+        ringBufferView<sample_t> v = segments(buf_up, wp, nframes*2);
+        memcpy(v.data[0], in, v.len[0]*sizeof(sample_t));
+        memcpy(v.data[1], in + v.len[0], v.len[1]*sizeof(sample_t));
+        publish(UP_WRITE, wp + nframes*2);
+        return nframes;
+    }
+
+    // Zero-copy: fill the returned view (interleaved stereo) in place, then
+    // commitUpstream() the same number of frames.
+    ringBufferView<sample_t> reserveUpstream(int nframes) {
+        return segments(buf_up, position(UP_WRITE), nframes*2);
+    }
+
+    void commitUpstream(int nframes) {
+        publish(UP_WRITE, position(UP_WRITE) + nframes*2);
+    }
+
     int receiveFromUpstream(sample_t** out, int nframes) {
-        if (dataAvailableOnUpstream(nframes)) {
-            for (int i=0; i<nframes; i++) {
-                out[0][i] = *(buf_up+(*urp));
-                out[1][i] = *(buf_up+(*urp)+1);
-                *urp = (*urp+2)&(STRBUFNUM-1);
-            }
-            return nframes;
-        } 
-        return 0;
+        return receive(buf_up, UP_WRITE, UP_READ, upCatchUp, out, nframes);
     }
 
     int sendToDownstream(sample_t** in, int nframes) {
-        for(int i=0; i<nframes; i++) {
-            *(buf_down+(*dwp)) = in[0][i];
-            *(buf_down+(*dwp)+1) = in[1][i];
-            *dwp = (*dwp+2)&(STRBUFNUM-1);
-        }
+        uint64_t wp = position(DOWN_WRITE);
+        interleave(buf_down, wp, in, nframes);
+        publish(DOWN_WRITE, wp + nframes*2);
         return nframes;
     }
 
     // To be fixed (Output is 32bit float stereo sigle stream)
     int receiveFromDownstream(sample_t** out, int nframes) {
-        if (dataAvailableOnDownstream(nframes)) {
-            for (int i=0; i<nframes; i++) {
-                out[0][i] = *(buf_down+(*drp));
-                out[1][i] = *(buf_down+(*drp)+1);
-                *drp = (*drp+2)&(BUFNUM-1);
-            }
-            return nframes;
+        return receive(buf_down, DOWN_WRITE, DOWN_READ, downCatchUp, out, nframes);
+    }
+
+    // Bulk variant: out receives interleaved stereo, copied with memcpy.
+    // No latency catch-up, returns 0 until nframes are available.
+    int receiveFromDownstream(sample_t* out, int nframes) {
+        ringBufferView<sample_t> v = peekDownstream(nframes);
+        if (v.size() < (size_t)nframes*2) {
+            return 0;
         }
-        return 0;
+        memcpy(out, v.data[0], v.len[0]*sizeof(sample_t));
+        memcpy(out + v.len[0], v.data[1], v.len[1]*sizeof(sample_t));
+        consumeDownstream(nframes);
+        return nframes;
+    }
+
+    // Zero-copy: up to nframes of interleaved stereo to be read in place,
+    // then consumeDownstream() the frames used.
+    ringBufferView<sample_t> peekDownstream(int nframes) {
+        uint64_t rp = position(DOWN_READ);
+        size_t fill = distance(position(DOWN_WRITE), rp);
+        size_t n = ((size_t)nframes < fill) ? nframes : fill;
+        return segments(buf_down, rp, n*2);
+    }
+
+    void consumeDownstream(int nframes) {
+        publish(DOWN_READ, position(DOWN_READ) + nframes*2);
     }
 };
 #endif
@@ -23,6 +23,8 @@ SOFTWARE.
 */
 
 #include <cstdio>
+#include <cstring>
+#include <new>
 #include <jack/jack.h>
 #include <jack/midiport.h>
 #include "jackClient.hpp"
@@ -36,6 +38,7 @@ int JackClient::process_callback(jack_nframes_t nframes) {
 
 int JackClient::_process_callback(jack_nframes_t nframes, void *arg) {
     JackClient* obj= (JackClient*)arg;
+    obj->begin_cycle(nframes);
     return obj->process_callback(nframes);
 }
 
@@ -58,12 +61,26 @@ void JackClient::_timebase_callback(jack_transport_state_t state, jack_nframes_t
     obj->timebase_callback(state, nframes, pos, new_pos);
 }
 
+void JackClient::freewheel_callback(int starting) {
+}
+
+void JackClient::_freewheel_callback(int starting, void *arg) {
+    JackClient* obj= (JackClient*)arg;
+    obj->freewheel_callback(starting);
+}
+
 /**********************************************************************
  public functions
 **********************************************************************/
-JackClient::JackClient(const char* name, uint32_t flags) {
+JackClientBase::JackClientBase(const char* name) {
     jack_status_t jst;
 
+    nAudioIn = nAudioOut = nMidiIn = nMidiOut = nPorts = 0;
+    audioIn = audioOut = midiIn = midiOut = ports = NULL;
+    audioInBuf = audioOutBuf = NULL;
+    midiInBuf = midiOutBuf = buffers = NULL;
+    midiBatch = NULL;
+
     client = jack_client_open(name, JackNullOption, &jst);
     if (!client) {
         //fprintf(stderr, "jack_client_open failed with %x\n", jst);
@@ -71,64 +88,83 @@ JackClient::JackClient(const char* name, uint32_t flags) {
     }
     SampleRate = jack_get_sample_rate(client);
     BufSize = jack_get_buffer_size(client);
-    cb_flags = flags;
 }
 
-JackClient::~JackClient() {
+JackClientBase::~JackClientBase() {
     jack_client_close(client);
-}
-
-int JackClient::register_ports(const char *nameAin[], const char *nameAout[],
-                               const char *nameMin[], const char *nameMout[]) {
-    int i;
-
-    //create Audio input ports
-    nAudioIn=0;
-    if (nameAin) {
-        for(i=0; (nameAin[i] != NULL)&&(i<MAX_PORT_NUM); i++) {
-            audioIn[i] = jack_port_register(client, nameAin[i],
-                JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
-        }
-        nAudioIn=i;
+    if (midiBatch) {
+        midiBatch->~MidiEventBatch();
+        arena_free(midiBatch);
     }
+    arena_free(ports);
+    arena_free(buffers);
+}
 
-    //create Audio output ports
-    nAudioOut=0;
-    if (nameAout) {
-        for(i=0; (nameAout[i] != NULL)&&(i<MAX_PORT_NUM); i++) {
-            audioOut[i] = jack_port_register(client, nameAout[i],
-                JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+static int count_names(const char* names[]) {
+    int n = 0;
+    if (names) {
+        while (names[n] != NULL) {
+            n++;
         }
-        nAudioOut=i;
     }
-    //create MIDI input ports
+    return n;
+}
 
-    nMidiIn=0;
-    if (nameMin) {
-        for(i=0; (nameMin[i] != NULL)&&(i<MAX_PORT_NUM); i++) {
-            midiIn[i] = jack_port_register(client, nameMin[i],
-                JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
-        }
-        nMidiIn=i;
+static void register_group(jack_client_t* client, jack_port_t** ports, const char* names[], int n,
+                           const char* type, unsigned long flags) {
+    for(int i=0; i<n; i++) {
+        ports[i] = jack_port_register(client, names[i], type, flags, 0);
     }
+}
 
-    //create MIDI output ports
-    nMidiOut=0;
-    if (nameMout) {
-        for(i=0; (nameMout[i] != NULL)&&(i<MAX_PORT_NUM); i++) {
-            midiOut[i] = jack_port_register(client, nameMout[i],
-                JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
-        }
-        nMidiOut=i;
+// Name lists are NULL terminated, any number of ports may be given.
+// Must be called once, before activate().
+int JackClientBase::register_ports(const char *nameAin[], const char *nameAout[],
+                               const char *nameMin[], const char *nameMout[]) {
+    nAudioIn = count_names(nameAin);
+    nAudioOut = count_names(nameAout);
+    nMidiIn = count_names(nameMin);
+    nMidiOut = count_names(nameMout);
+    nPorts = nAudioIn + nAudioOut + nMidiIn + nMidiOut;
+
+    ports = (jack_port_t**)arena_alloc(sizeof(jack_port_t*)*(nPorts+1));
+    buffers = (void**)arena_alloc(sizeof(void*)*(nPorts+1));
+    memset(buffers, 0, sizeof(void*)*(nPorts+1));
+
+    audioIn = ports;
+    audioOut = audioIn + nAudioIn;
+    midiIn = audioOut + nAudioOut;
+    midiOut = midiIn + nMidiIn;
+
+    audioInBuf = (sample_t**)buffers;
+    audioOutBuf = audioInBuf + nAudioIn;
+    midiInBuf = (void**)(audioOutBuf + nAudioOut);
+    midiOutBuf = midiInBuf + nMidiIn;
+
+    register_group(client, audioIn, nameAin, nAudioIn, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput);
+    register_group(client, audioOut, nameAout, nAudioOut, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput);
+    register_group(client, midiIn, nameMin, nMidiIn, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
+    register_group(client, midiOut, nameMout, nMidiOut, JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput);
+
+    if ((nMidiIn > 0) || (nMidiOut > 0)) {
+        int maxPorts = (nMidiIn > nMidiOut) ? nMidiIn : nMidiOut;
+        midiBatch = new (arena_alloc(sizeof(MidiEventBatch))) MidiEventBatch(maxPorts);
     }
     return 0;
 }
 
+JackClient::JackClient(const char* name, uint32_t flags) : JackClientBase(name) {
+    cb_flags = flags;
+}
+
 void JackClient::activate() {
     if (cb_flags & JACK_PROCESS_CALLBACK) {
         jack_set_process_callback(client, _process_callback, this);
     }
-    //jack_set_freewheel_callback(client, _freewheel_callback, arg);
+    if (cb_flags & JACK_FREEWHEEL_CALLBACK) {
+        if (jack_set_freewheel_callback(client, _freewheel_callback, this) != 0)
+             fprintf(stderr, "jack_set_freewheel_callback() failed\n");
+    }
     //jack_on_shutdown(client, _on_shutdown, arg);
 
     if (cb_flags & JACK_SYNC_CALLBACK) {
@@ -146,18 +182,43 @@ void JackClient::activate() {
 
 // Jack APIs
 // Transport APIs
-void JackClient::transport_start() {
+void JackClientBase::transport_start() {
     jack_transport_start(client);
 }
 
-void JackClient::transport_stop() {
+void JackClientBase::transport_stop() {
     jack_transport_stop(client);
 }
 
-jack_transport_state_t JackClient::transport_query(jack_position_t* pos) {
+jack_transport_state_t JackClientBase::transport_query(jack_position_t* pos) {
     return jack_transport_query(client, pos);
 }
 
-int JackClient::transport_reposition(const jack_position_t* pos) {
+int JackClientBase::transport_reposition(const jack_position_t* pos) {
     return jack_transport_reposition(client, pos);
 }
+
+// Batched MIDI APIs
+// Returns all events of this cycle on midiIn[] sorted by time.
+// midiEvent_t::port is the index in midiIn[]. Collected once per cycle.
+const midiEvent_t* JackClientBase::get_midi_events(jack_nframes_t nframes, int* count) {
+    if (midiBatch == NULL) {
+        *count = 0;
+        return NULL;
+    }
+    if (midiBatch->collected()) {
+        return midiBatch->collected_events(count);
+    }
+    return midiBatch->collect(midiInBuf, nMidiIn, count);
+}
+
+// Scratch memory for outgoing event data, released at the next cycle.
+jack_midi_data_t* JackClientBase::alloc_midi_data(size_t size) {
+    return midiBatch ? midiBatch->alloc(size) : NULL;
+}
+
+// Clears all midiOut[] and writes events into them.
+// midiEvent_t::port is the index in midiOut[].
+int JackClientBase::put_midi_events(const midiEvent_t* events, int count, jack_nframes_t nframes) {
+    return midiBatch ? midiBatch->write(midiOutBuf, nMidiOut, events, count) : 0;
+}
@@ -22,12 +22,14 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <cstdio>
+#include <type_traits>
 #include <jack/jack.h>
 #include <jack/midiport.h>
+#include "midiEvents.hpp"
 
 #ifndef __JACKCLIENT_HPP__
 #define __JACKCLIENT_HPP__
-#define MAX_PORT_NUM 16
 typedef jack_default_audio_sample_t sample_t;
 
 #define JACK_PROCESS_CALLBACK      0x0001
@@ -47,41 +49,158 @@ typedef jack_default_audio_sample_t sample_t;
 /**********************************************************************
  Jack functions
 **********************************************************************/
-class JackClient {
+class JackClientBase {
 protected:
     jack_client_t* client;
-    jack_port_t *audioIn[MAX_PORT_NUM], *audioOut[MAX_PORT_NUM];
-    jack_port_t *midiIn[MAX_PORT_NUM], *midiOut[MAX_PORT_NUM];
+    // All ports in one table: audio in, audio out, MIDI in, MIDI out.
+    // The tables below point into it and are sized by register_ports().
+    jack_port_t **audioIn, **audioOut;
+    jack_port_t **midiIn, **midiOut;
+
+    // Buffers of the ports above in the same layout, fetched in one pass
+    // at the top of every cycle before process_callback is called.
+    // The table is cache line aligned.
+    sample_t **audioInBuf, **audioOutBuf;
+    void **midiInBuf, **midiOutBuf;
 
     int nAudioIn, nAudioOut, nMidiIn, nMidiOut;
     int SampleRate;
     jack_nframes_t BufSize;
     bool is_master;
 
-    virtual int process_callback(jack_nframes_t nframes);
-    virtual int sync_callback(jack_transport_state_t state, jack_position_t *pos);
-    virtual void timebase_callback(jack_transport_state_t state, jack_nframes_t nframes,
-                                       jack_position_t *pos, int new_pos);
-
     // Transport API
     void transport_start();
     void transport_stop();
     jack_transport_state_t transport_query(jack_position_t* pos);
     int transport_reposition(const jack_position_t* pos);
 
+    // Batched MIDI API (only valid inside process_callback)
+    const midiEvent_t* get_midi_events(jack_nframes_t nframes, int* count);
+    jack_midi_data_t* alloc_midi_data(size_t size);
+    int put_midi_events(const midiEvent_t* events, int count, jack_nframes_t nframes);
+
+    // Called at the top of every process cycle. Buffers are only valid
+    // for the cycle they were fetched in, so every port is fetched again.
+    void begin_cycle(jack_nframes_t nframes) {
+        for(int i=0; i<nPorts; i++) {
+            buffers[i] = jack_port_get_buffer(ports[i], nframes);
+        }
+        if (midiBatch) {
+            midiBatch->reset();
+        }
+    }
+
+private:
+    int nPorts;
+    jack_port_t** ports;
+    void** buffers;
+    MidiEventBatch* midiBatch;
+
+public:
+    JackClientBase(const char* name);
+    ~JackClientBase();
+
+    int register_ports(const char* nameAin[], const char* nameAout[],
+                   const char* nameMin[], const char* nameMout[]);
+};
+
+// Callbacks are virtual functions, registered according to cb_flags.
+class JackClient : public JackClientBase {
+protected:
+    virtual int process_callback(jack_nframes_t nframes);
+    virtual int sync_callback(jack_transport_state_t state, jack_position_t *pos);
+    virtual void timebase_callback(jack_transport_state_t state, jack_nframes_t nframes,
+                                       jack_position_t *pos, int new_pos);
+    virtual void freewheel_callback(int starting);
+
 private:
     uint32_t cb_flags;
     static int _process_callback(jack_nframes_t nframes, void *arg);
     static int _sync_callback(jack_transport_state_t state, jack_position_t *pos, void *arg);
     static void _timebase_callback(jack_transport_state_t state, jack_nframes_t nframes,
                           jack_position_t *pos, int new_pos, void *arg);
+    static void _freewheel_callback(int starting, void *arg);
 
 public:
     JackClient(const char* name, uint32_t cb_flags);
-    ~JackClient();
     void activate();
+};
 
-    int register_ports(const char* nameAin[], const char* nameAout[],
-                   const char* nameMin[], const char* nameMout[]);
+// Static dispatch variant: class Foo : public JackClientT<Foo>.
+// Only the callbacks Foo defines (process_callback, sync_callback,
+// timebase_callback, freewheel_callback, with the same signatures as
+// JackClient) are
+// registered, and they are called without virtual dispatch. They must be
+// public, or Foo must be a friend of JackClientT<Foo>.
+template<class Derived>
+class JackClientT : public JackClientBase {
+public:
+    JackClientT(const char* name) : JackClientBase(name) {
+    }
+
+    void activate() {
+        set_process(decltype(has_process<Derived>(nullptr))());
+        set_sync(decltype(has_sync<Derived>(nullptr))());
+        set_timebase(decltype(has_timebase<Derived>(nullptr))());
+        set_freewheel(decltype(has_freewheel<Derived>(nullptr))());
+        jack_activate(client);
+    }
+
+private:
+    // std::true_type if T declares the callback
+    template<class T> static std::true_type has_process(decltype(&T::process_callback));
+    template<class T> static std::false_type has_process(...);
+    template<class T> static std::true_type has_sync(decltype(&T::sync_callback));
+    template<class T> static std::false_type has_sync(...);
+    template<class T> static std::true_type has_timebase(decltype(&T::timebase_callback));
+    template<class T> static std::false_type has_timebase(...);
+    template<class T> static std::true_type has_freewheel(decltype(&T::freewheel_callback));
+    template<class T> static std::false_type has_freewheel(...);
+
+    static Derived* self(void* arg) {
+        return static_cast<Derived*>((JackClientT*)arg);
+    }
+
+    static int _process_callback(jack_nframes_t nframes, void *arg) {
+        Derived* obj = self(arg);
+        obj->begin_cycle(nframes);
+        return obj->process_callback(nframes);
+    }
+
+    static int _sync_callback(jack_transport_state_t state, jack_position_t *pos, void *arg) {
+        return self(arg)->sync_callback(state, pos);
+    }
+
+    static void _timebase_callback(jack_transport_state_t state, jack_nframes_t nframes,
+                          jack_position_t *pos, int new_pos, void *arg) {
+        self(arg)->timebase_callback(state, nframes, pos, new_pos);
+    }
+
+    static void _freewheel_callback(int starting, void *arg) {
+        self(arg)->freewheel_callback(starting);
+    }
+
+    void set_process(std::false_type) {}
+    void set_process(std::true_type) {
+        jack_set_process_callback(client, _process_callback, this);
+    }
+
+    void set_sync(std::false_type) {}
+    void set_sync(std::true_type) {
+        if (jack_set_sync_callback(client, _sync_callback, this) != 0)
+             fprintf(stderr, "jack_set_sync_callback() failed\n");
+    }
+
+    void set_timebase(std::false_type) {}
+    void set_timebase(std::true_type) {
+        if (jack_set_timebase_callback(client, 1, _timebase_callback, this) != 0)
+             fprintf(stderr, "Unable to take over timebase.\n");
+    }
+
+    void set_freewheel(std::false_type) {}
+    void set_freewheel(std::true_type) {
+        if (jack_set_freewheel_callback(client, _freewheel_callback, this) != 0)
+             fprintf(stderr, "jack_set_freewheel_callback() failed\n");
+    }
 };
 #endif
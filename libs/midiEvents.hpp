@@ -0,0 +1,286 @@
+/*
+MIT License
+
+Copyright (c) 2016 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include "arena.hpp"
+#include "ump.hpp"
+
+#ifndef __MIDIEVENTS_HPP__
+#define __MIDIEVENTS_HPP__
+
+typedef struct midiEvent {
+    jack_nframes_t          time;
+    int                     port;   // index of the port in the array given
+    size_t                  size;
+    const jack_midi_data_t* data;   // valid until the end of the cycle
+} midiEvent_t;
+
+// One Universal MIDI Packet, ump_packet_words(words[0]) of words are used
+typedef struct umpEvent {
+    jack_nframes_t          time;
+    int                     port;
+    uint32_t                words[UMP_MAX_WORDS];
+} umpEvent_t;
+
+#define MIDI_BATCH_EVENTS  4096
+#define MIDI_BATCH_ARENA   (64*1024)
+
+/**********************************************************************
+ Per-cycle batch of MIDI events
+
+ collect() gathers the events of all given ports into one array sorted
+ by time (stable, so events of the same time keep port order). Event data
+ is not copied, it points into the Jack port buffers. alloc() hands out
+ scratch bytes for composing outgoing events. Everything is preallocated
+ and released at once by reset() at the top of each cycle.
+
+ With maxPackets > 0 the collected events are also available as fixed
+ size UMP records (collect_ump()), and write_ump() turns such records back
+ into Jack MIDI events, so that per-event processing can work on packets
+ in place instead of parsing byte messages.
+**********************************************************************/
+class MidiEventBatch {
+public:
+    MidiEventBatch(int _maxPorts, int _maxEvents = MIDI_BATCH_EVENTS, size_t _arenaSize = MIDI_BATCH_ARENA, int _maxPackets = 0)
+        : maxPorts(_maxPorts), maxEvents(_maxEvents), maxPackets(_maxPackets), arenaSize(_arenaSize) {
+        events = (midiEvent_t*)arena_alloc(sizeof(midiEvent_t)*maxEvents*2);
+        packets = (maxPackets > 0) ? (umpEvent_t*)arena_alloc(sizeof(umpEvent_t)*maxPackets) : NULL;
+        runs = (int*)arena_alloc(sizeof(int)*(maxPorts+1));
+        buffers = (void**)arena_alloc(sizeof(void*)*maxPorts);
+        arena = (jack_midi_data_t*)arena_alloc(arenaSize);
+        lost = 0;
+        reset();
+    }
+
+    ~MidiEventBatch() {
+        arena_free(events);
+        arena_free(packets);
+        arena_free(runs);
+        arena_free(buffers);
+        arena_free(arena);
+    }
+
+    void reset() {
+        sorted = NULL;
+        nevents = 0;
+        arenaUsed = 0;
+    }
+
+    bool collected() const {
+        return (sorted != NULL);
+    }
+
+    // Result of the last collect() since reset().
+    const midiEvent_t* collected_events(int* count) const {
+        *count = nevents;
+        return sorted;
+    }
+
+    // Returns the events of ports[0..nports-1] sorted by time.
+    const midiEvent_t* collect(jack_port_t** ports, int nports, jack_nframes_t nframes, int* count) {
+        if (nports > maxPorts) {
+            nports = maxPorts;
+        }
+        for (int p=0; p<nports; p++) {
+            buffers[p] = jack_port_get_buffer(ports[p], nframes);
+        }
+        return collect(buffers, nports, count);
+    }
+
+    // Same as above with the port buffers already fetched for this cycle.
+    const midiEvent_t* collect(void* const* portBuffers, int nports, int* count) {
+        jack_midi_event_t ev;
+        int n = 0;
+
+        if (nports > maxPorts) {
+            nports = maxPorts;
+        }
+        runs[0] = 0;
+        for (int p=0; p<nports; p++) {
+            void* buf = portBuffers[p];
+            int num = jack_midi_get_event_count(buf);
+            for (int i=0; i<num; i++) {
+                if (n >= maxEvents) {
+                    lost += num - i;
+                    break;
+                }
+                if (jack_midi_event_get(&ev, buf, i) != 0) {
+                    continue;
+                }
+                events[n].time = ev.time;
+                events[n].port = p;
+                events[n].size = ev.size;
+                events[n].data = ev.buffer;
+                n++;
+            }
+            runs[p+1] = n;
+        }
+        nevents = n;
+
+        // every port is already sorted, so merge the runs pairwise
+        midiEvent_t* src = events;
+        midiEvent_t* dst = events + maxEvents;
+        for (int width=1; width<nports; width*=2) {
+            for (int r=0; r<nports; r+=width*2) {
+                int lo = runs[r];
+                int mid = runs[(r+width < nports) ? r+width : nports];
+                int hi = runs[(r+width*2 < nports) ? r+width*2 : nports];
+                merge(src, lo, mid, hi, dst);
+            }
+            midiEvent_t* tmp = src;
+            src = dst;
+            dst = tmp;
+        }
+        sorted = src;
+        *count = nevents;
+        return sorted;
+    }
+
+    // Returns scratch memory valid until the next reset(), NULL if exhausted.
+    jack_midi_data_t* alloc(size_t size) {
+        if (arenaUsed + size > arenaSize) {
+            return NULL;
+        }
+        jack_midi_data_t* p = arena + arenaUsed;
+        arenaUsed += size;
+        return p;
+    }
+
+    // Clears ports[0..nports-1] and writes the events into them.
+    // Events for each port must be in time order. Returns the number written.
+    int write(jack_port_t** ports, int nports, jack_nframes_t nframes, const midiEvent_t* ev, int count) {
+        if (nports > maxPorts) {
+            nports = maxPorts;
+        }
+        for (int p=0; p<nports; p++) {
+            buffers[p] = jack_port_get_buffer(ports[p], nframes);
+        }
+        return write(buffers, nports, ev, count);
+    }
+
+    // Same as above with the port buffers already fetched for this cycle.
+    int write(void* const* portBuffers, int nports, const midiEvent_t* ev, int count) {
+        int written = 0;
+
+        for (int p=0; p<nports; p++) {
+            jack_midi_clear_buffer(portBuffers[p]);
+        }
+        for (int i=0; i<count; i++) {
+            if ((ev[i].port < 0) || (ev[i].port >= nports)) {
+                continue;
+            }
+            if (jack_midi_event_write(portBuffers[ev[i].port], ev[i].time, ev[i].data, ev[i].size) == 0) {
+                written++;
+            }
+        }
+        return written;
+    }
+
+    // Converts the events of the last collect() into UMP packets of group 0,
+    // in the same order. A SysEx message becomes consecutive data packets.
+    // protocol: UMP_PROTOCOL_MIDI1 or UMP_PROTOCOL_MIDI2 (16/32 bit values).
+    const umpEvent_t* collect_ump(int protocol, int* count) {
+        int n = 0;
+
+        encoder.set_protocol(protocol);
+        for (int i=0; (i<nevents) && (sorted != NULL); i++) {
+            const midiEvent_t& ev = sorted[i];
+            size_t pos = 0;
+            while (true) {
+                if (n >= maxPackets) {
+                    lost += nevents - i;
+                    *count = n;
+                    return packets;
+                }
+                int words = encoder.encode_next(ev.data, ev.size, &pos, packets[n].words);
+                if (words == 0) {
+                    break;
+                }
+                packets[n].time = ev.time;
+                packets[n].port = ev.port;
+                n++;
+            }
+        }
+        *count = n;
+        return packets;
+    }
+
+    // Clears ports[0..nports-1] and writes the packets into them as MIDI 1.0
+    // events. The packets of a SysEx message must be consecutive. Returns the
+    // number of events written.
+    int write_ump(void* const* portBuffers, int nports, const umpEvent_t* pkt, int count) {
+        const unsigned char* msg;
+        int written = 0;
+
+        for (int p=0; p<nports; p++) {
+            jack_midi_clear_buffer(portBuffers[p]);
+        }
+        for (int i=0; i<count; i++) {
+            if ((pkt[i].port < 0) || (pkt[i].port >= nports)) {
+                continue;
+            }
+            size_t size = decoder.decode(pkt[i].words, &msg);
+            if ((size > 0) && (jack_midi_event_write(portBuffers[pkt[i].port], pkt[i].time, msg, size) == 0)) {
+                written++;
+            }
+        }
+        return written;
+    }
+
+    // number of input events which didn't fit (since start)
+    uint64_t lost_count() const {
+        return lost;
+    }
+
+private:
+    int maxPorts, maxEvents, maxPackets;
+    size_t arenaSize, arenaUsed;
+    midiEvent_t* events;    // two halves of maxEvents, for merging
+    umpEvent_t* packets;
+    UmpEncoder encoder;
+    UmpDecoder decoder;
+    midiEvent_t* sorted;
+    int nevents;
+    int* runs;
+    void** buffers;
+    jack_midi_data_t* arena;
+    uint64_t lost;
+
+    static void merge(const midiEvent_t* src, int lo, int mid, int hi, midiEvent_t* dst) {
+        int i = lo, j = mid, k = lo;
+        while ((i < mid) && (j < hi)) {
+            dst[k++] = (src[j].time < src[i].time) ? src[j++] : src[i++];
+        }
+        while (i < mid) {
+            dst[k++] = src[i++];
+        }
+        while (j < hi) {
+            dst[k++] = src[j++];
+        }
+    }
+};
+#endif
@@ -0,0 +1,159 @@
+/*
+MIT License
+
+Copyright (c) 2016-2018 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <atomic>
+#include "arena.hpp"
+
+#ifndef __RINGBUFFER_HPP__
+#define __RINGBUFFER_HPP__
+
+#define RINGBUFFER_ALIGN 64 // cache line
+
+// Up to two contiguous pieces of a ring buffer region
+template <typename T>
+struct ringBufferView {
+    T*     data[2];
+    size_t len[2];
+
+    size_t size() const {
+        return len[0] + len[1];
+    }
+};
+
+/**********************************************************************
+ Single producer / single consumer ring buffer
+
+ Read and write positions are 64 bit counters which only increase, so
+ the fill level is always (write - read) and never wraps. Capacity must
+ be a power of 2; positions are masked at compile time. T must be
+ trivially copyable, bulk transfers are done with memcpy.
+
+ Producer: write(), reserve()/commit()
+ Consumer: read(), peek()/consume()
+**********************************************************************/
+template <typename T, size_t Capacity>
+class RingBuffer {
+    static_assert((Capacity > 0) && ((Capacity & (Capacity - 1)) == 0), "Capacity must be a power of 2");
+
+public:
+    static const size_t capacity = Capacity;
+
+    RingBuffer() : wcount(0), rcount(0) {
+        buf = (T*)arena_alloc(sizeof(T)*Capacity, RINGBUFFER_ALIGN);
+    }
+
+    ~RingBuffer() {
+        arena_free(buf);
+    }
+
+    // Splits [pos, pos+n) of a ring of Capacity elements at base into two
+    // contiguous pieces. Also used for rings living in shared memory.
+    static ringBufferView<T> segments(T* base, uint64_t pos, size_t n) {
+        ringBufferView<T> v;
+        size_t offset = (size_t)(pos & (Capacity - 1));
+        size_t first = Capacity - offset;
+        v.data[0] = base + offset;
+        v.len[0] = (n < first) ? n : first;
+        v.data[1] = base;
+        v.len[1] = n - v.len[0];
+        return v;
+    }
+
+    uint64_t write_count() const {
+        return wcount.load(std::memory_order_acquire);
+    }
+
+    uint64_t read_count() const {
+        return rcount.load(std::memory_order_acquire);
+    }
+
+    size_t readable() const {
+        return (size_t)(wcount.load(std::memory_order_acquire) - rcount.load(std::memory_order_relaxed));
+    }
+
+    size_t writable() const {
+        return Capacity - (size_t)(wcount.load(std::memory_order_relaxed) - rcount.load(std::memory_order_acquire));
+    }
+
+    // producer side: copies up to n elements, returns the number written
+    size_t write(const T* src, size_t n) {
+        ringBufferView<T> v = reserve(n);
+        memcpy(v.data[0], src, v.len[0]*sizeof(T));
+        memcpy(v.data[1], src + v.len[0], v.len[1]*sizeof(T));
+        commit(v.size());
+        return v.size();
+    }
+
+    // producer side: up to n free elements to be filled in place
+    ringBufferView<T> reserve(size_t n) {
+        size_t room = writable();
+        return segments(buf, wcount.load(std::memory_order_relaxed), (n < room) ? n : room);
+    }
+
+    void commit(size_t n) {
+        wcount.store(wcount.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // consumer side: copies up to n elements, returns the number read
+    size_t read(T* dst, size_t n) {
+        ringBufferView<T> v = peek(n);
+        memcpy(dst, v.data[0], v.len[0]*sizeof(T));
+        memcpy(dst + v.len[0], v.data[1], v.len[1]*sizeof(T));
+        consume(v.size());
+        return v.size();
+    }
+
+    // consumer side: up to n available elements to be read in place
+    ringBufferView<T> peek(size_t n) const {
+        size_t avail = readable();
+        return segments(buf, rcount.load(std::memory_order_relaxed), (n < avail) ? n : avail);
+    }
+
+    void consume(size_t n) {
+        rcount.store(rcount.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // Not thread safe, only while neither side is running
+    void reset() {
+        wcount.store(0, std::memory_order_relaxed);
+        rcount.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    // counters are kept a cache line apart (padding rather than alignas,
+    // so that the class can still be allocated with new in C++11)
+    T* buf;
+    char pad0[RINGBUFFER_ALIGN];
+    std::atomic<uint64_t> wcount;
+    char pad1[RINGBUFFER_ALIGN - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> rcount;
+    char pad2[RINGBUFFER_ALIGN - sizeof(std::atomic<uint64_t>)];
+
+    RingBuffer(const RingBuffer&);
+    RingBuffer& operator=(const RingBuffer&);
+};
+#endif
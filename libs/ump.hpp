@@ -0,0 +1,298 @@
+/*
+MIT License
+
+Copyright (c) 2016 Shunji Uno <madhatter68@linux-dtm.ivory.ne.jp>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __UMP_HPP__
+#define __UMP_HPP__
+#include <stdint.h>
+#include <cstddef>
+
+/******************************************************************************
+ MIDI 2.0 Universal MIDI Packet (UMP) support
+
+ UmpEncoder / UmpDecoder convert between complete MIDI 1.0 messages and
+ 32/64 bit packets (see MidiEventBatch::collect_ump()). Channel voice
+ messages can be sent either as MIDI 1.0 packets (MT 2) or as MIDI 2.0
+ packets (MT 4) with 16/32 bit values, SysEx goes as 7 bit data packets
+ (MT 3) of up to 6 bytes each.
+******************************************************************************/
+#define UMP_MT_UTILITY   0x0
+#define UMP_MT_SYSTEM    0x1
+#define UMP_MT_MIDI1_CV  0x2
+#define UMP_MT_DATA64    0x3
+#define UMP_MT_MIDI2_CV  0x4
+
+#define UMP_PROTOCOL_MIDI1  1
+#define UMP_PROTOCOL_MIDI2  2
+
+#define UMP_MAX_WORDS    4
+#define UMP_SYSEX_MAX    8192
+
+static inline int ump_packet_words(uint32_t word0) {
+    static const unsigned char words[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+    return words[word0 >> 28];
+}
+
+// Min-Center-Max scaling of the MIDI 2.0 specification
+static inline uint32_t ump_upscale(uint32_t value, int srcBits, int dstBits) {
+    int scaleBits = dstBits - srcBits;
+    uint32_t shifted = value << scaleBits;
+    if (value <= (1u << (srcBits - 1))) {
+        return shifted;
+    }
+    int repeatBits = srcBits - 1;
+    uint32_t repeat = value & ((1u << repeatBits) - 1);
+    repeat = (scaleBits > repeatBits) ? (repeat << (scaleBits - repeatBits))
+                                      : (repeat >> (repeatBits - scaleBits));
+    while (repeat != 0) {
+        shifted |= repeat;
+        repeat >>= repeatBits;
+    }
+    return shifted;
+}
+
+static inline uint32_t ump_downscale(uint32_t value, int srcBits, int dstBits) {
+    return value >> (srcBits - dstBits);
+}
+
+/******************************************************************************
+ MIDI 1.0 byte stream -> UMP
+******************************************************************************/
+class UmpEncoder {
+public:
+    UmpEncoder() : group(0), protocol(UMP_PROTOCOL_MIDI1) {
+    }
+
+    void set_group(int _group) {
+        group = _group & 0x0f;
+    }
+
+    void set_protocol(int _protocol) {
+        protocol = _protocol;
+    }
+
+    // Upper bound of words needed for a message of size bytes
+    static size_t max_words(size_t size) {
+        return (size / 6 + 1) * 2;
+    }
+
+    // Converts the complete MIDI 1.0 message msg[0..size) one packet at a
+    // time, starting at *pos. Returns the number of words written into pkt,
+    // or 0 when the whole message has been converted.
+    int encode_next(const unsigned char* msg, size_t size, size_t* pos, uint32_t* pkt) const {
+        if ((*pos >= size) || (size == 0)) {
+            return 0;
+        }
+        unsigned char status = msg[0];
+        uint32_t head = (uint32_t)group << 24;
+
+        if (status == 0xf0) {
+            return encode_sysex(msg, size, pos, pkt);
+        }
+        *pos = size;
+
+        unsigned char d1 = (size > 1) ? msg[1] : 0;
+        unsigned char d2 = (size > 2) ? msg[2] : 0;
+        if (status >= 0xf1) {
+            pkt[0] = ((uint32_t)UMP_MT_SYSTEM << 28) | head | (status << 16) | (d1 << 8) | d2;
+            return 1;
+        }
+        if (status < 0x80) {
+            return 0; // running status is not expected here
+        }
+        if (protocol == UMP_PROTOCOL_MIDI1) {
+            pkt[0] = ((uint32_t)UMP_MT_MIDI1_CV << 28) | head | (status << 16) | (d1 << 8) | d2;
+            return 1;
+        }
+
+        // MIDI 2.0 channel voice
+        unsigned char op = status & 0xf0;
+        uint32_t index = 0, value = 0;
+        switch (op) {
+            case 0x90:
+                if (d2 == 0) {
+                    op = 0x80; // Note On with velocity 0 is a Note Off
+                }
+                // fall through
+            case 0x80:
+                index = d1 << 8;
+                value = ump_upscale(d2, 7, 16) << 16;
+                break;
+            case 0xa0:
+            case 0xb0:
+                index = d1 << 8;
+                value = ump_upscale(d2, 7, 32);
+                break;
+            case 0xc0:
+                value = (uint32_t)d1 << 24;
+                break;
+            case 0xd0:
+                value = ump_upscale(d1, 7, 32);
+                break;
+            case 0xe0:
+                value = ump_upscale(((uint32_t)d2 << 7) | d1, 14, 32);
+                break;
+        }
+        pkt[0] = ((uint32_t)UMP_MT_MIDI2_CV << 28) | head | ((op | (status & 0x0f)) << 16) | index;
+        pkt[1] = value;
+        return 2;
+    }
+
+private:
+    int group;
+    int protocol;
+
+    // F0 and F7 are not carried, each packet has up to 6 data bytes
+    int encode_sysex(const unsigned char* msg, size_t size, size_t* pos, uint32_t* pkt) const {
+        size_t end = (msg[size-1] == 0xf7) ? size - 1 : size;
+        size_t start = (*pos == 0) ? 1 : *pos;
+        size_t n = (end > start) ? end - start : 0;
+        if (n > 6) {
+            n = 6;
+        }
+        bool first = (start == 1);
+        bool last = (start + n >= end);
+        uint32_t status = first ? (last ? 0 : 1) : (last ? 3 : 2);
+        unsigned char b[6] = { 0, 0, 0, 0, 0, 0 };
+        for (size_t i=0; i<n; i++) {
+            b[i] = msg[start+i];
+        }
+        pkt[0] = ((uint32_t)UMP_MT_DATA64 << 28) | ((uint32_t)group << 24) | (status << 20)
+                 | ((uint32_t)n << 16) | (b[0] << 8) | b[1];
+        pkt[1] = ((uint32_t)b[2] << 24) | (b[3] << 16) | (b[4] << 8) | b[5];
+        *pos = last ? size : start + n;
+        return 2;
+    }
+};
+
+/******************************************************************************
+ UMP -> MIDI 1.0 byte stream
+******************************************************************************/
+class UmpDecoder {
+public:
+    UmpDecoder() : sysexLen(0), inSysex(false) {
+    }
+
+    // Converts one packet. Returns the size of the complete MIDI 1.0 message
+    // stored at *msg, or 0 if there is nothing to send (SysEx in progress,
+    // utility or unsupported packets). *msg stays valid until the next call.
+    size_t decode(const uint32_t* pkt, const unsigned char** msg) {
+        uint32_t w0 = pkt[0];
+        unsigned char status = (w0 >> 16) & 0xff;
+
+        *msg = buf;
+        switch (w0 >> 28) {
+            case UMP_MT_SYSTEM:
+                buf[0] = status;
+                buf[1] = (w0 >> 8) & 0x7f;
+                buf[2] = w0 & 0x7f;
+                return ((status == 0xf1) || (status == 0xf3)) ? 2 : (status == 0xf2) ? 3 : 1;
+
+            case UMP_MT_MIDI1_CV:
+                buf[0] = status;
+                buf[1] = (w0 >> 8) & 0x7f;
+                buf[2] = w0 & 0x7f;
+                return ((status & 0xe0) == 0xc0) ? 2 : 3;
+
+            case UMP_MT_MIDI2_CV:
+                return decode_midi2(w0, pkt[1]);
+
+            case UMP_MT_DATA64:
+                return decode_sysex(w0, pkt[1], msg);
+        }
+        return 0;
+    }
+
+private:
+    unsigned char buf[3];
+    unsigned char sysex[UMP_SYSEX_MAX];
+    size_t sysexLen;
+    bool inSysex;
+
+    size_t decode_midi2(uint32_t w0, uint32_t w1) {
+        unsigned char status = (w0 >> 16) & 0xff;
+        unsigned char index = (w0 >> 8) & 0x7f;
+        uint32_t v;
+
+        buf[0] = status;
+        buf[1] = index;
+        switch (status & 0xf0) {
+            case 0x80:
+                buf[2] = ump_downscale(w1 >> 16, 16, 7);
+                return 3;
+            case 0x90:
+                v = ump_downscale(w1 >> 16, 16, 7);
+                buf[2] = (v == 0) ? 1 : v; // velocity 0 would mean Note Off
+                return 3;
+            case 0xa0:
+            case 0xb0:
+                buf[2] = ump_downscale(w1, 32, 7);
+                return 3;
+            case 0xc0:
+                buf[1] = (w1 >> 24) & 0x7f;
+                return 2;
+            case 0xd0:
+                buf[1] = ump_downscale(w1, 32, 7);
+                return 2;
+            case 0xe0:
+                v = ump_downscale(w1, 32, 14);
+                buf[1] = v & 0x7f;
+                buf[2] = v >> 7;
+                return 3;
+        }
+        return 0; // per-note and registered controllers have no MIDI 1.0 form
+    }
+
+    size_t decode_sysex(uint32_t w0, uint32_t w1, const unsigned char** msg) {
+        uint32_t status = (w0 >> 20) & 0x0f;
+        size_t n = (w0 >> 16) & 0x0f;
+        unsigned char b[6] = { (unsigned char)((w0 >> 8) & 0x7f), (unsigned char)(w0 & 0x7f),
+                               (unsigned char)((w1 >> 24) & 0x7f), (unsigned char)((w1 >> 16) & 0x7f),
+                               (unsigned char)((w1 >> 8) & 0x7f), (unsigned char)(w1 & 0x7f) };
+        if (n > 6) {
+            n = 6;
+        }
+        if ((status == 0) || (status == 1)) {
+            sysex[0] = 0xf0;
+            sysexLen = 1;
+            inSysex = true;
+        } else if (!inSysex) {
+            return 0;
+        }
+        if (sysexLen + n + 1 > UMP_SYSEX_MAX) {
+            inSysex = false; // too long, drop it
+            return 0;
+        }
+        for (size_t i=0; i<n; i++) {
+            sysex[sysexLen++] = b[i];
+        }
+        if ((status == 0) || (status == 3)) {
+            sysex[sysexLen++] = 0xf7;
+            inSysex = false;
+            *msg = sysex;
+            return sysexLen;
+        }
+        return 0;
+    }
+};
+#endif
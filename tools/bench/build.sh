@@ -0,0 +1,5 @@
+# Build benchmarks (runs on Linux/macOS against the stand-ins under stub/)
+g++ -Wall -O2 -std=c++11 -Istub -I../../daemon -o midibench midibench.cpp
+g++ -Wall -O2 -std=c++11 -Istub -I../../libs -o catchupbench catchupbench.cpp
+g++ -Wall -O2 -std=c++11 -I../../driver/JackBridge/Plug-In -o drivercorebench drivercorebench.cpp
+g++ -Wall -O2 -std=c++11 -pthread -o propertybench propertybench.cpp
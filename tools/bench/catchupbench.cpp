@@ -0,0 +1,302 @@
+/*
+ File: catchupbench.cpp
+
+ Latency catch-up benchmark for audioStream (libs/audio.hpp).
+
+ A 997 Hz sine is written one period at a time. After a warm-up a burst of
+ extra frames is written once, which raises the fill level over the limit.
+ The same stream is read back with the former hard read pointer jump and
+ with the smooth catch-up, and for both the number of periods to get back
+ to the target, the largest step between two output samples (a clean sine
+ stays below 2*pi*f/fs) and the CPU time per period are reported. The run
+ fails unless the smooth catch-up has the smaller step and gets back to the
+ target within the periods latencyCatchUp promises for -P and -d (see
+ audio.hpp). 997 Hz doesn't divide 48 kHz, so a jump never skips whole sine
+ periods by chance.
+
+ With -n the smooth run goes through multiChannelStream instead: every
+ channel carries the same sine, each period is written with one commit and
+ the run fails if any channel ever differs from channel 0.
+
+ Usage: catchupbench [-f frames/period] [-b burst frames] [-P catch-up periods]
+                     [-d max drift] [-t target] [-l limit] [-c cycles]
+                     [-n 2|8|64 channels] [-j]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include "audio.hpp"
+
+typedef std::chrono::steady_clock benchClock;
+
+struct result {
+    int periods;        // periods from the burst until back at the target
+    double maxStep;     // largest |out[i] - out[i-1]|
+    double nsPerPeriod; // average read time per period
+    double nsCatchUp;   // average read time per period while catching up
+    size_t misaligned;  // frames where the channels didn't match
+};
+
+class sineSource {
+public:
+    sineSource(double freq, double rate) : phase(0), inc(2*M_PI*freq/rate) {
+    }
+    void fill(sample_t* buf, int n) {
+        for (int i=0; i<n; i++) {
+            buf[i] = (sample_t)sin(phase);
+            phase += inc;
+        }
+    }
+private:
+    double phase, inc;
+};
+
+// the read path as it was: snap the read pointer once over MAX_DELAY
+class jumpStream {
+public:
+    int sendToStream(sample_t* in, int nframes) {
+        return ring.write(in, nframes);
+    }
+    int receiveFromStream(sample_t* out, int nframes) {
+        size_t diff = ring.readable();
+        if (diff < (size_t)nframes) {
+            return 0;
+        }
+        if (diff > (size_t)limit) {
+            uint64_t rp = (ring.write_count() - nframes) & ~(uint64_t)(nframes - 1);
+            if (rp > ring.read_count()) {
+                ring.consume(rp - ring.read_count());
+            }
+        }
+        return ring.read(out, nframes);
+    }
+    size_t fill() const {
+        return ring.readable();
+    }
+    size_t misaligned(int got) const {
+        (void)got;
+        return 0;
+    }
+    void setLatency(int target, int _limit, int periods, int drift) {
+        (void)target; (void)periods; (void)drift;
+        limit = _limit;
+    }
+private:
+    RingBuffer<sample_t, BUFNUM> ring;
+    int limit;
+};
+
+class smoothStream : public audioStream {
+public:
+    size_t fill() {
+        return framesAvailable();
+    }
+    size_t misaligned(int got) const {
+        (void)got;
+        return 0;
+    }
+};
+
+// the mono input on every channel of a multiChannelStream
+template <int Channels>
+class multiStream : public multiChannelStream<Channels> {
+public:
+    multiStream() {
+        for (int c=0; c<Channels; c++) {
+            out[c] = buf[c];
+        }
+    }
+    int sendToStream(sample_t* in, int nframes) {
+        sample_t* ins[Channels];
+        for (int c=0; c<Channels; c++) {
+            ins[c] = in;
+        }
+        return multiChannelStream<Channels>::sendToStream(ins, nframes);
+    }
+    int receiveFromStream(sample_t* o, int nframes) {
+        int got = multiChannelStream<Channels>::receiveFromStream(out, nframes);
+        memcpy(o, out[0], got*sizeof(sample_t));
+        return got;
+    }
+    size_t fill() {
+        return this->framesAvailable();
+    }
+    // frames of the last read where a channel differs from channel 0
+    size_t misaligned(int got) const {
+        size_t bad = 0;
+        for (int i=0; i<got; i++) {
+            for (int c=1; c<Channels; c++) {
+                if (out[c][i] != out[0][i]) {
+                    bad++;
+                    break;
+                }
+            }
+        }
+        return bad;
+    }
+private:
+    // padded so that the channels don't all map to the same cache sets
+    sample_t buf[Channels][MAX_FRAME_SIZE + 16];
+    sample_t* out[Channels];
+};
+
+template <class Stream>
+static result run(int nframes, int burst, int periods, int drift, int target, int limit, int cycles) {
+    Stream* stream = new Stream;
+    stream->setLatency(target, limit, periods, drift);
+    sineSource src(997.0, 48000.0);
+    std::vector<sample_t> in(nframes + burst), out(nframes);
+    result r = { -1, 0.0, 0.0, 0.0, 0 };
+    size_t goal = (target ? target : nframes) + nframes;
+    sample_t last = 0;
+    bool haveLast = false;
+    int burstAt = cycles / 4;
+    uint64_t totalNs = 0, catchUpNs = 0, catchUpPeriods = 0;
+
+    // prime one period of latency
+    src.fill(in.data(), nframes);
+    stream->sendToStream(in.data(), nframes);
+
+    for (int c=0; c<cycles; c++) {
+        int n = nframes + ((c == burstAt) ? burst : 0);
+        src.fill(in.data(), n);
+        stream->sendToStream(in.data(), n);
+        bool catching = (c >= burstAt) && (r.periods < 0);
+
+        benchClock::time_point t0 = benchClock::now();
+        int got = stream->receiveFromStream(out.data(), nframes);
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(benchClock::now() - t0).count();
+        totalNs += ns;
+        if (catching) {
+            catchUpNs += ns;
+            catchUpPeriods++;
+        }
+
+        r.misaligned += stream->misaligned(got);
+        for (int i=0; i<got; i++) {
+            if (haveLast && (fabs(out[i] - last) > r.maxStep)) {
+                r.maxStep = fabs(out[i] - last);
+            }
+            last = out[i];
+            haveLast = true;
+        }
+        if (catching && (stream->fill() + nframes <= goal)) {
+            r.periods = c - burstAt + 1;
+        }
+    }
+    r.nsPerPeriod = (double)totalNs / cycles;
+    r.nsCatchUp = catchUpPeriods ? (double)catchUpNs / catchUpPeriods : 0.0;
+    delete stream;
+    return r;
+}
+
+int
+main(int argc, char** argv)
+{
+    int ch;
+    int nframes = 256, burst = 2048, periods = CATCHUP_PERIODS, drift = CATCHUP_MAX_DRIFT;
+    int target = 0, limit = MAX_DELAY, cycles = 20000, channels = 1;
+    bool json = false;
+
+    while ((ch = getopt(argc, argv, "f:b:P:d:t:l:c:n:j")) != -1) {
+        switch (ch) {
+            case 'f':
+                nframes = atoi(optarg);
+                break;
+            case 'b':
+                burst = atoi(optarg);
+                break;
+            case 'P':
+                periods = atoi(optarg);
+                break;
+            case 'd':
+                drift = atoi(optarg);
+                break;
+            case 't':
+                target = atoi(optarg);
+                break;
+            case 'l':
+                limit = atoi(optarg);
+                break;
+            case 'c':
+                cycles = atoi(optarg);
+                break;
+            case 'n':
+                channels = atoi(optarg);
+                break;
+            case 'j':
+                json = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-f frames/period] [-b burst frames] [-P catch-up periods] "
+                                "[-d max drift] [-t target] [-l limit] [-c cycles] "
+                                "[-n 2|8|64 channels] [-j]\n", argv[0]);
+                return -1;
+        }
+    }
+    if ((nframes <= 0) || (nframes > MAX_FRAME_SIZE) || (burst < 0) || (nframes + burst*2 >= BUFNUM) || (cycles < 8) ||
+        (periods <= 0) || (drift <= 0) ||
+        ((channels != 1) && (channels != 2) && (channels != 8) && (channels != 64))) {
+        fprintf(stderr, "%s: invalid parameter\n", argv[0]);
+        return -1;
+    }
+
+    result jump = run<jumpStream>(nframes, burst, periods, drift, target, limit, cycles);
+    result smooth;
+    switch (channels) {
+        case 2:
+            smooth = run<multiStream<2> >(nframes, burst, periods, drift, target, limit, cycles);
+            break;
+        case 8:
+            smooth = run<multiStream<8> >(nframes, burst, periods, drift, target, limit, cycles);
+            break;
+        case 64:
+            smooth = run<multiStream<64> >(nframes, burst, periods, drift, target, limit, cycles);
+            break;
+        default:
+            smooth = run<smoothStream>(nframes, burst, periods, drift, target, limit, cycles);
+            break;
+    }
+    double cleanStep = 2*M_PI*997.0/48000.0;
+
+    // the burst read sees one primed and one regular period on top of it
+    int peak = nframes*2 + burst, goal = (target ? target : nframes) + nframes;
+    latencyCatchUp bound;
+    bound.configure(target, limit, periods, drift);
+    int expected = ((peak > limit) && (peak > goal)) ? bound.catchUpPeriods(peak - goal, nframes) : -1;
+
+    if (json) {
+        printf("{\"benchmark\":\"catchupbench\",\"frames_per_period\":%d,\"burst\":%d,\"catchup_periods\":%d,\"max_drift\":%d,\"channels\":%d,"
+               "\"target\":%d,\"limit\":%d,\"cycles\":%d,\"clean_step\":%.6f,\"expected_periods\":%d,",
+               nframes, burst, periods, drift, channels, target, limit, cycles, cleanStep, expected);
+        printf("\"jump\":{\"periods\":%d,\"max_step\":%.6f,\"ns_per_period\":%.1f,\"ns_catchup\":%.1f},",
+               jump.periods, jump.maxStep, jump.nsPerPeriod, jump.nsCatchUp);
+        printf("\"smooth\":{\"periods\":%d,\"max_step\":%.6f,\"ns_per_period\":%.1f,\"ns_catchup\":%.1f,"
+               "\"misaligned\":%zu}}\n",
+               smooth.periods, smooth.maxStep, smooth.nsPerPeriod, smooth.nsCatchUp, smooth.misaligned);
+    } else {
+        printf("frames/period: %d, burst: %d, catch-up periods: %d, max drift: 1/%d, channels: %d, target: %d, "
+               "limit: %d, cycles: %d\n", nframes, burst, periods, drift, channels, target, limit, cycles);
+        printf("clean sine max step: %.6f, catch-up bound: %d periods\n", cleanStep, expected);
+        printf("jump  : back at target after %d periods, max step %.6f, %.1f ns/period (%.1f while catching up)\n",
+               jump.periods, jump.maxStep, jump.nsPerPeriod, jump.nsCatchUp);
+        printf("smooth: back at target after %d periods, max step %.6f, %.1f ns/period (%.1f while catching up)\n",
+               smooth.periods, smooth.maxStep, smooth.nsPerPeriod, smooth.nsCatchUp);
+        if (channels > 1) {
+            printf("smooth: %zu misaligned frames over %d channels\n", smooth.misaligned, channels);
+        }
+    }
+    if (smooth.misaligned > 0) {
+        fprintf(stderr, "%s: channels out of phase in %zu frames\n", argv[0], smooth.misaligned);
+        return 1;
+    }
+    if ((expected > 0) && ((smooth.periods < 0) || (smooth.periods > expected))) {
+        fprintf(stderr, "%s: catch-up took %d periods, bound is %d\n", argv[0], smooth.periods, expected);
+        return 1;
+    }
+    return (smooth.maxStep < jump.maxStep) ? 0 : 1;
+}
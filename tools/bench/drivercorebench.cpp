@@ -0,0 +1,285 @@
+/*
+ File: drivercorebench.cpp
+
+ Driver IO path benchmark and fuzzer for BridgeDeviceCore
+ (driver/JackBridge/Plug-In/BridgeDeviceCore.h).
+
+ The shared memory is emulated in process and the calls coreaudiod makes
+ on the device are replayed once per IO cycle: GetZeroTimeStamp, then
+ ReadInput for every input stream and WriteMix for every output stream.
+ The daemon side is played by the benchmark, which fills the downstream
+ rings and checks the upstream rings, the frame number registers, the
+ time stamps and guard areas around every ring after each cycle.
+
+ With '-z <seed>' IO buffer sizes and sample times are randomized (jumps
+ included) to exercise the wrap-split copies. '-n' sets the channels
+ per frame of every ring, '-g' the gain of every stream (the copies of
+ the first cycle ramp to it and aren't checked), '-p' the frames between
+ zero time stamps (default: one per ring). '-l' sets the frames the daemon
+ runs ahead of the IO, the safety offset and latency derived from it after
+ the run are checked. '-r' sets the sample rate the host clock runs at,
+ the real-time factor is the audio time of the frames copied per time
+ spent copying them. The ring of 4096 frames is the one of 2 channels at
+ 48kHz and of 8 channels at 192kHz.
+
+ Usage: drivercorebench [-f frames/IO] [-c cycles] [-i inputs] [-o outputs]
+                        [-n channels] [-g gain] [-p period] [-l lead] [-r rate]
+                        [-z seed] [-j]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include "BridgeDeviceCore.h"
+
+typedef std::chrono::steady_clock benchClock;
+typedef BridgeDeviceCore::sample_t sample_t;
+
+#define RING_FRAMES     4096
+#define GUARD_SAMPLES   64
+#define MAX_CHANNELS    64
+#define GUARD_VALUE     -12345.0f
+
+static int channels = BRIDGE_CORE_CHANNELS;
+
+// one emulated ring with guard areas on both sides
+class guardedRing {
+public:
+    guardedRing() : mem(RING_FRAMES*channels + GUARD_SAMPLES*2, GUARD_VALUE) {
+    }
+    sample_t* ring() {
+        return mem.data() + GUARD_SAMPLES;
+    }
+    sample_t& at(uint64_t frame, int ch) {
+        return ring()[(frame % RING_FRAMES)*channels + ch];
+    }
+    bool guards_intact() const {
+        for (int i=0; i<GUARD_SAMPLES; i++) {
+            if ((mem[i] != GUARD_VALUE) || (mem[mem.size()-1-i] != GUARD_VALUE)) {
+                return false;
+            }
+        }
+        return true;
+    }
+private:
+    std::vector<sample_t> mem;
+};
+
+// exactly representable, different for every frame/channel/stream in a window
+static sample_t pattern(uint64_t frame, int ch, int stream) {
+    return (sample_t)(((frame * MAX_CHANNELS + ch) * 8 + stream) & 0xffffff);
+}
+
+int
+main(int argc, char** argv)
+{
+    int ch;
+    int nframes = 512, cycles = 200000, nin = 1, nout = 2, period = RING_FRAMES, lead = 0, rate = 48000;
+    unsigned int seed = 0;
+    bool fuzz = false, json = false;
+    float gain = 1.0f;
+
+    while ((ch = getopt(argc, argv, "f:c:i:o:n:g:p:l:r:z:j")) != -1) {
+        switch (ch) {
+            case 'f':
+                nframes = atoi(optarg);
+                break;
+            case 'c':
+                cycles = atoi(optarg);
+                break;
+            case 'i':
+                nin = atoi(optarg);
+                break;
+            case 'o':
+                nout = atoi(optarg);
+                break;
+            case 'n':
+                channels = atoi(optarg);
+                break;
+            case 'g':
+                gain = atof(optarg);
+                break;
+            case 'p':
+                period = atoi(optarg);
+                break;
+            case 'l':
+                lead = atoi(optarg);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 'z':
+                fuzz = true;
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'j':
+                json = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-f frames/IO] [-c cycles] [-i inputs] [-o outputs] [-n channels] [-g gain] [-p period] [-l lead] [-r rate] [-z seed] [-j]\n", argv[0]);
+                return -1;
+        }
+    }
+    if ((nframes <= 0) || (nframes > RING_FRAMES) || (cycles <= 0) ||
+        (nin < 0) || (nin > BRIDGE_CORE_MAX_STREAMS) || (nout < 0) || (nout > BRIDGE_CORE_MAX_STREAMS) || (channels <= 0) || (channels > MAX_CHANNELS) ||
+        (period <= 0) || (period > RING_FRAMES) || (lead < 0) || (lead >= RING_FRAMES/2) || (rate <= 0)) {
+        fprintf(stderr, "%s: invalid parameter\n", argv[0]);
+        return -1;
+    }
+    srand(seed);
+
+    // emulated shm
+    std::vector<guardedRing> down(nin), up(nout);
+    std::vector<uint64_t> readFrame(nin), writeFrame(nout);
+    volatile uint64_t numberTimeStamps = 0, zeroHostTime = 0, seedReg = 1, syncMode = 0;
+    volatile uint64_t daemonFrame = 0, jackPeriod = 0;
+
+    BridgeDeviceCore core;
+    for (int s=0; s<nin; s++) {
+        core.attach_input(s, down[s].ring(), &readFrame[s]);
+    }
+    for (int s=0; s<nout; s++) {
+        core.attach_output(s, up[s].ring(), &writeFrame[s]);
+    }
+    core.attach_timebase(&numberTimeStamps, &zeroHostTime, &seedReg, &syncMode);
+    core.attach_daemon(&daemonFrame, &jackPeriod);
+    core.set_format(channels, RING_FRAMES);
+    double hostTicksPerFrame = 1e9 / rate;
+    core.set_host_ticks_per_frame(hostTicksPerFrame);
+    core.set_period_frames(period);
+    core.commit();
+    core.start(0);
+    for (int s=0; s<BRIDGE_CORE_MAX_STREAMS; s++) {
+        core.set_input_gain(s, gain);
+        core.set_output_gain(s, gain);
+    }
+
+    std::vector<sample_t> io(RING_FRAMES*channels);
+    uint64_t sampleTime = 0, totalNs = 0, frames = 0, errors = 0, lastStamp = 0;
+    double ticksPerPeriod = hostTicksPerFrame * period;
+
+    for (int c=0; c<cycles; c++) {
+        int n = nframes;
+        if (fuzz) {
+            n = 1 + rand() % RING_FRAMES;
+            if ((rand() % 64) == 0) {
+                sampleTime += rand() % (RING_FRAMES*4); // discontinuity
+            }
+        }
+        uint64_t now = (uint64_t)((sampleTime + n) * hostTicksPerFrame);
+
+        // daemon side: the frames the driver is going to read
+        for (int s=0; s<nin; s++) {
+            for (int i=0; i<n; i++) {
+                for (int k=0; k<channels; k++) {
+                    down[s].at(sampleTime + i, k) = pattern(sampleTime + i, k, s);
+                }
+            }
+        }
+        daemonFrame = sampleTime + n + lead;
+        jackPeriod = n;
+
+        // the IO cycle as coreaudiod runs it, the HAL asks for a time stamp
+        // at least once per period
+        benchClock::time_point t0 = benchClock::now();
+        double stampSample = 0;
+        uint64_t stampHost = 0, stampSeed = 0;
+        for (int p=0; p<(n + period - 1)/period; p++) {
+            core.get_zero_time_stamp(now, stampSample, stampHost, stampSeed);
+        }
+        for (int s=0; s<nin; s++) {
+            core.read_input(s, n, (double)sampleTime, io.data());
+        }
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(benchClock::now() - t0).count();
+
+        // check the input copy (last stream) before io is reused for output
+        bool ramping = (c == 0) && (gain != 1.0f);
+        if ((nin > 0) && !ramping) {
+            for (int i=0; i<n; i++) {
+                for (int k=0; k<channels; k++) {
+                    if (io[i*channels + k] != pattern(sampleTime + i, k, nin - 1) * gain) {
+                        errors++;
+                    }
+                }
+            }
+        }
+
+        for (int s=0; s<nout; s++) {
+            for (int i=0; i<n; i++) {
+                for (int k=0; k<channels; k++) {
+                    io[i*channels + k] = pattern(sampleTime + i, k, s + BRIDGE_CORE_MAX_STREAMS/2);
+                }
+            }
+            t0 = benchClock::now();
+            core.write_output(s, n, (double)sampleTime, io.data());
+            ns += std::chrono::duration_cast<std::chrono::nanoseconds>(benchClock::now() - t0).count();
+        }
+        totalNs += ns;
+        frames += n;
+
+        // daemon side: what the driver published
+        for (int s=0; s<nout; s++) {
+            for (int i=0; i<n; i++) {
+                for (int k=0; k<channels; k++) {
+                    if (!ramping && (up[s].at(sampleTime + i, k) != pattern(sampleTime + i, k, s + BRIDGE_CORE_MAX_STREAMS/2) * gain)) {
+                        errors++;
+                    }
+                }
+            }
+            errors += (writeFrame[s] != sampleTime + n);
+        }
+        for (int s=0; s<nin; s++) {
+            errors += (readFrame[s] != sampleTime + n);
+        }
+
+        // time stamps: one per period, never ahead of now, never going back
+        errors += ((uint64_t)stampSample % period) != 0;
+        errors += (stampHost > now) || (stampHost < lastStamp) || (stampSeed != seedReg);
+        if (!fuzz) {
+            errors += ((double)(now - stampHost) >= ticksPerPeriod);
+        }
+        lastStamp = stampHost;
+
+        sampleTime += n;
+    }
+
+    for (int s=0; s<nin; s++) {
+        errors += !down[s].guards_intact();
+    }
+    for (int s=0; s<nout; s++) {
+        errors += !up[s].guards_intact();
+    }
+
+    // input: 'lead' frames to spare, output: 'lead' frames late, from no offset
+    BridgeDeviceCore::latency_t applied = { 0, 0 };
+    BridgeDeviceCore::latency_t inputLatency = applied, outputLatency = applied;
+    core.update_latency(applied, applied, inputLatency, outputLatency);
+    if (!fuzz) {
+        errors += (nin > 0) && ((inputLatency.safetyOffset != (uint32_t)((lead < BRIDGE_CORE_SAFETY_FRAMES) ? BRIDGE_CORE_SAFETY_FRAMES - lead : 0)) ||
+                                (inputLatency.latency != (uint32_t)lead / 8));
+        errors += (nout > 0) && ((outputLatency.safetyOffset != (uint32_t)(lead + BRIDGE_CORE_SAFETY_FRAMES)) || (outputLatency.latency != 0));
+    }
+
+    double nsPerCycle = (double)totalNs / cycles;
+    double nsPerFrame = frames ? (double)totalNs / frames : 0.0;
+    double realtimeFactor = totalNs ? ((double)frames / rate) / (totalNs * 1e-9) : 0.0;
+    if (json) {
+        printf("{\"benchmark\":\"drivercorebench\",\"frames_per_io\":%d,\"cycles\":%d,\"inputs\":%d,\"outputs\":%d,\"channels\":%d,\"gain\":%g,\"period\":%d,\"lead\":%d,\"rate\":%d,"
+               "\"safety_offset_in\":%u,\"safety_offset_out\":%u,\"latency_in\":%u,\"latency_out\":%u,\"fuzz\":%s,\"seed\":%u,\"frames\":%llu,\"ns_per_cycle\":%.1f,\"ns_per_frame\":%.3f,\"realtime_factor\":%.0f,\"errors\":%llu}\n",
+               nframes, cycles, nin, nout, channels, gain, period, lead, rate,
+               inputLatency.safetyOffset, outputLatency.safetyOffset, inputLatency.latency, outputLatency.latency, fuzz ? "true" : "false", seed, (unsigned long long)frames,
+               nsPerCycle, nsPerFrame, realtimeFactor, (unsigned long long)errors);
+    } else {
+        printf("frames/IO: %s, cycles: %d, inputs: %d, outputs: %d, channels: %d, gain: %g, period: %d, rate: %d\n",
+               fuzz ? "random" : std::to_string(nframes).c_str(), cycles, nin, nout, channels, gain, period, rate);
+        printf("IO cycle: %.1f ns (%.3f ns/frame) over %llu frames, %.0fx real time\n",
+               nsPerCycle, nsPerFrame, (unsigned long long)frames, realtimeFactor);
+        printf("safety offset: %u in, %u out, latency: %u in, %u out (lead: %d)\n",
+               inputLatency.safetyOffset, outputLatency.safetyOffset, inputLatency.latency, outputLatency.latency, lead);
+        printf("errors: %llu\n", (unsigned long long)errors);
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,460 @@
+/*
+ File: midibench.cpp
+
+ MIDI throughput and latency benchmark for the daemon's MIDI bridge path
+ (MidiEventBatch::collect + MidiBridge::process, as called from JackBridge),
+ run against the JACK and RtMidi stand-ins under tools/bench/stub.
+
+ Every cycle, each Jack MIDI input port and each CoreMIDI input port is
+ filled with a generated event stream, then one bridge cycle is run.
+ Latency is measured per event from the start of the cycle to the moment
+ the event is delivered (RtMidiOut::sendMessage or jack_midi_event_reserve).
+ Heap allocations made during the bridge cycle are counted by replacing the
+ global operator new.
+
+ Usage: midibench [-t note|cc|dense|sysex] [-e events/cycle] [-c cycles]
+                  [-f frames/cycle] [-p ports] [-s sysex bytes]
+                  [-F filter] [-u 1|2] [-j]
+
+ -F sets MidiBridge::add_filter(), the byte volume handed to CoreMIDI and
+ to Jack is reported to show its effect.
+ -u also converts the Jack input events of every cycle to UMP (MIDI 1.0 or
+ MIDI 2.0 protocol, MidiEventBatch::collect_ump) and back into Jack ports
+ (write_ump). That round trip is timed on its own and checked against the
+ input, the run fails on any difference.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include "midiBridge.hpp"
+
+/******************************************************************************
+ allocation counter
+******************************************************************************/
+static bool     countAllocs = false;
+static uint64_t numAllocs = 0;
+
+// The complete replaceable set, so that every new is paired with a delete of
+// this file. They aren't inlined into the callers, where the compiler would
+// otherwise see an operator new matched with a plain free().
+__attribute__((noinline)) void* operator new(size_t size) {
+    if (countAllocs) {
+        numAllocs++;
+    }
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) noexcept {
+    operator delete(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+/******************************************************************************
+ timing
+******************************************************************************/
+typedef std::chrono::steady_clock benchClock;
+
+static benchClock::time_point cycleStart;
+static std::vector<uint64_t> latOut;    // Jack -> CoreMIDI (ns)
+static std::vector<uint64_t> latIn;     // CoreMIDI -> Jack (ns)
+static uint64_t deliveredOut = 0, deliveredIn = 0;
+static uint64_t bytesOut = 0, bytesIn = 0;
+
+static inline uint64_t elapsed_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(benchClock::now() - cycleStart).count();
+}
+
+static void on_send(RtMidiOut* port, const unsigned char* message, size_t size) {
+    (void)port; (void)message;
+    bytesOut += size;
+    if (deliveredOut < latOut.size()) {
+        latOut[deliveredOut] = elapsed_ns();
+    }
+    deliveredOut++;
+}
+
+static void on_reserve(void* port_buffer, jack_nframes_t time, size_t size) {
+    (void)port_buffer; (void)time;
+    bytesIn += size;
+    if (deliveredIn < latIn.size()) {
+        latIn[deliveredIn] = elapsed_ns();
+    }
+    deliveredIn++;
+}
+
+/******************************************************************************
+ event stream generators
+******************************************************************************/
+enum streamType { STREAM_NOTE, STREAM_CC, STREAM_DENSE, STREAM_SYSEX };
+
+class eventGenerator {
+public:
+    eventGenerator(streamType _type, int _sysexSize) : type(_type), sysexSize(_sysexSize), seq(0), seed(12345), lastNote(0) {
+        if (sysexSize < 3) {
+            sysexSize = 3;
+        }
+    }
+
+    // writes next event into msg and returns its size
+    size_t next(unsigned char* msg) {
+        size_t size = 0;
+        unsigned int ch = seq & 0x0f;
+
+        switch(type) {
+            case STREAM_NOTE:
+                // note storm: alternating note on/off on pseudo random notes
+                if ((seq & 1) == 0) {
+                    lastNote = rand7();
+                    msg[0] = 0x90 | ch;
+                    msg[1] = lastNote;
+                    msg[2] = 1 + (rand7() % 127);
+                } else {
+                    msg[0] = 0x80 | ch;
+                    msg[1] = lastNote;
+                    msg[2] = 0;
+                }
+                size = 3;
+                break;
+
+            case STREAM_CC:
+                // controller sweep: every controller ramps through its range
+                msg[0] = 0xb0 | (ch & 0x3);
+                msg[1] = (seq >> 2) % 120;
+                msg[2] = (seq >> 4) & 0x7f;
+                size = 3;
+                break;
+
+            case STREAM_DENSE:
+                // controller stream of one channel mixed with clock and active sensing
+                if ((seq & 3) == 3) {
+                    msg[0] = ((seq & 15) == 15) ? 0xfe : 0xf8;
+                    size = 1;
+                } else {
+                    msg[0] = 0xb0;
+                    msg[1] = (seq >> 2) & 0x0f;
+                    msg[2] = (seq >> 4) & 0x7f;
+                    size = 3;
+                }
+                break;
+
+            case STREAM_SYSEX:
+                // sysex burst with non-commercial manufacturer ID
+                msg[0] = 0xf0;
+                msg[1] = 0x7d;
+                for (int i=2; i<sysexSize-1; i++) {
+                    msg[i] = (seq + i) & 0x7f;
+                }
+                msg[sysexSize-1] = 0xf7;
+                size = sysexSize;
+                break;
+        }
+        seq++;
+        return size;
+    }
+
+private:
+    streamType type;
+    int sysexSize;
+    unsigned int seq;
+    unsigned int seed;
+    unsigned char lastNote;
+
+    unsigned char rand7() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7f;
+    }
+};
+
+/******************************************************************************
+ statistics
+******************************************************************************/
+static uint64_t percentile(std::vector<uint64_t>& v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    size_t idx = (size_t)(p * (v.size() - 1) + 0.5);
+    return v[idx];
+}
+
+struct latencyStats {
+    uint64_t p50, p99, p999, max;
+};
+
+static latencyStats summarize(std::vector<uint64_t>& v, uint64_t n) {
+    latencyStats st = {0, 0, 0, 0};
+    if (n < v.size()) {
+        v.resize(n);
+    }
+    std::sort(v.begin(), v.end());
+    st.p50 = percentile(v, 0.50);
+    st.p99 = percentile(v, 0.99);
+    st.p999 = percentile(v, 0.999);
+    st.max = v.empty() ? 0 : v.back();
+    return st;
+}
+
+// number of ports whose events differ between a and b
+static int compare_ports(const std::vector<void*>& a, const std::vector<void*>& b) {
+    int errors = 0;
+    for (size_t n=0; n<a.size(); n++) {
+        int count = jack_midi_get_event_count(a[n]);
+        bool same = (count == (int)jack_midi_get_event_count(b[n]));
+        for (int i=0; same && (i<count); i++) {
+            jack_midi_event_t ea, eb;
+            same = (jack_midi_event_get(&ea, a[n], i) == 0) && (jack_midi_event_get(&eb, b[n], i) == 0)
+                   && (ea.time == eb.time) && (ea.size == eb.size) && (memcmp(ea.buffer, eb.buffer, ea.size) == 0);
+        }
+        errors += !same;
+    }
+    return errors;
+}
+
+/******************************************************************************
+ main
+******************************************************************************/
+int
+main(int argc, char** argv)
+{
+    int ch;
+    streamType type = STREAM_NOTE;
+    const char* typeName = "note";
+    int eventsPerCycle = 64, cycles = 10000, nframes = 256, nports = 1, sysexSize = 64;
+    bool json = false;
+    const char* filter = NULL;
+    int ump = 0;
+
+    while ((ch = getopt(argc, argv, "t:e:c:f:p:s:F:u:j")) != -1) {
+        switch (ch) {
+            case 't':
+                if (strcmp(optarg, "note") == 0) {
+                    type = STREAM_NOTE;
+                } else if (strcmp(optarg, "cc") == 0) {
+                    type = STREAM_CC;
+                } else if (strcmp(optarg, "dense") == 0) {
+                    type = STREAM_DENSE;
+                } else if (strcmp(optarg, "sysex") == 0) {
+                    type = STREAM_SYSEX;
+                } else {
+                    fprintf(stderr, "%s: unknown stream type %s\n", argv[0], optarg);
+                    return -1;
+                }
+                typeName = optarg;
+                break;
+            case 'e':
+                eventsPerCycle = atoi(optarg);
+                break;
+            case 'c':
+                cycles = atoi(optarg);
+                break;
+            case 'f':
+                nframes = atoi(optarg);
+                break;
+            case 'p':
+                nports = atoi(optarg);
+                break;
+            case 's':
+                sysexSize = atoi(optarg);
+                break;
+            case 'F':
+                filter = optarg;
+                break;
+            case 'u':
+                ump = atoi(optarg);
+                if ((ump != UMP_PROTOCOL_MIDI1) && (ump != UMP_PROTOCOL_MIDI2)) {
+                    fprintf(stderr, "%s: unknown UMP protocol %s (1 or 2)\n", argv[0], optarg);
+                    return -1;
+                }
+                break;
+            case 'j':
+                json = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t note|cc|dense|sysex] [-e events/cycle] [-c cycles] "
+                                "[-f frames/cycle] [-p ports] [-s sysex bytes] [-F filter] [-u 1|2] [-j]\n", argv[0]);
+                return -1;
+        }
+    }
+    if ((eventsPerCycle <= 0) || (cycles <= 0) || (nframes <= 0) || (nports <= 0) || (nports > MAX_MIDI_PORTS)) {
+        fprintf(stderr, "%s: invalid parameter\n", argv[0]);
+        return -1;
+    }
+
+    // Set up the bridge and the stand-in ports, the bridge allocates from
+    // the arena as in the daemon
+    Arena::global().init();
+    MidiBridge bridge;
+    bridge.create_ports("midibench", nports, nports);
+    if ((filter != NULL) && !bridge.add_filter(filter)) {
+        fprintf(stderr, "%s: invalid filter %s\n", argv[0], filter);
+        return -1;
+    }
+    bridge.open_ports();
+
+    std::vector<jack_port_t> jackIn(nports), jackOut(nports);
+    std::vector<jack_port_t*> pIn(nports), pOut(nports);
+    std::vector<void*> bufIn(nports), bufOut(nports), bufUmp(nports);
+    for (int n=0; n<nports; n++) {
+        bufUmp[n] = jack_stub_midi_buffer_new();
+        jackIn[n].buffer = jack_stub_midi_buffer_new();
+        jackIn[n].connections = 1;
+        jackOut[n].buffer = jack_stub_midi_buffer_new();
+        jackOut[n].connections = 1;
+        pIn[n] = &jackIn[n];
+        pOut[n] = &jackOut[n];
+    }
+
+    MidiEventBatch batch(nports, MIDI_BATCH_EVENTS, MIDI_BATCH_ARENA, ump ? MIDI_BATCH_EVENTS*4 : 0);
+    Arena::global().seal();
+
+    // CoreMIDI side input ports are created by the bridge itself
+    std::vector<RtMidiIn*> coreIn(nports);
+    for (int n=0; n<nports; n++) {
+        coreIn[n] = bridge.input_port(n);
+    }
+
+    uint64_t eventsPerDir = (uint64_t)eventsPerCycle * nports * cycles;
+    latOut.assign(eventsPerDir, 0);
+    latIn.assign(eventsPerDir, 0);
+    rtmidi_stub_send_hook = on_send;
+    jack_stub_midi_write_hook = on_reserve;
+
+    eventGenerator genJack(type, sysexSize), genCore(type, sysexSize);
+    std::vector<unsigned char> msg(sysexSize > 3 ? sysexSize : 3);
+    uint64_t totalNs = 0, allocs = 0, bytesGenerated = 0;
+    uint64_t umpNs = 0, umpPackets = 0, umpEvents = 0, umpErrors = 0;
+
+    for (int c=0; c<cycles; c++) {
+        // Jack side: events spread over the period
+        for (int n=0; n<nports; n++) {
+            jack_midi_clear_buffer(jackIn[n].buffer);
+            jack_stub_midi_write_hook = NULL;
+            for (int i=0; i<eventsPerCycle; i++) {
+                size_t size = genJack.next(msg.data());
+                bytesGenerated += size;
+                jack_midi_event_write(jackIn[n].buffer, (jack_nframes_t)((uint64_t)i * nframes / eventsPerCycle), msg.data(), size);
+            }
+            jack_stub_midi_write_hook = on_reserve;
+        }
+
+        // CoreMIDI side: events arriving from the MIDI thread
+        for (int n=0; n<nports; n++) {
+            for (int i=0; i<eventsPerCycle; i++) {
+                size_t size = genCore.next(msg.data());
+                bytesGenerated += size;
+                coreIn[n]->stub_push(msg.data(), size);
+            }
+        }
+
+        uint64_t before = numAllocs;
+        countAllocs = true;
+        cycleStart = benchClock::now();
+        batch.reset();
+        int count;
+        for (int n=0; n<nports; n++) {
+            bufIn[n] = jack_port_get_buffer(pIn[n], nframes);
+            bufOut[n] = jack_port_get_buffer(pOut[n], nframes);
+        }
+        const midiEvent_t* events = batch.collect(bufIn.data(), nports, &count);
+        bridge.process(events, count, bufOut.data());
+        totalNs += elapsed_ns();
+
+        if (ump) {
+            jack_stub_midi_write_hook = NULL;
+            benchClock::time_point umpStart = benchClock::now();
+            int npackets;
+            const umpEvent_t* packets = batch.collect_ump(ump, &npackets);
+            int written = batch.write_ump(bufUmp.data(), nports, packets, npackets);
+            umpNs += std::chrono::duration_cast<std::chrono::nanoseconds>(benchClock::now() - umpStart).count();
+            jack_stub_midi_write_hook = on_reserve;
+            umpPackets += npackets;
+            umpEvents += written;
+            umpErrors += (written != count);
+            umpErrors += compare_ports(bufIn, bufUmp);
+        }
+        countAllocs = false;
+        allocs += numAllocs - before;
+    }
+
+    latencyStats out = summarize(latOut, deliveredOut);
+    latencyStats in = summarize(latIn, deliveredIn);
+    uint64_t delivered = deliveredOut + deliveredIn;
+    double seconds = totalNs / 1e9;
+    double rate = (seconds > 0) ? delivered / seconds : 0;
+
+    if (json) {
+        printf("{\"benchmark\":\"midibench\",\"stream\":\"%s\",\"ports\":%d,\"events_per_cycle\":%d,"
+               "\"cycles\":%d,\"frames_per_cycle\":%d,\"sysex_bytes\":%d,",
+               typeName, nports, eventsPerCycle, cycles, nframes, (type == STREAM_SYSEX) ? sysexSize : 0);
+        printf("\"events_generated\":%llu,\"events_delivered\":%llu,\"seconds\":%.9f,\"events_per_sec\":%.1f,",
+               (unsigned long long)(eventsPerDir*2), (unsigned long long)delivered, seconds, rate);
+        printf("\"latency_ns\":{\"jack_to_coremidi\":{\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu},"
+               "\"coremidi_to_jack\":{\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}},",
+               (unsigned long long)out.p50, (unsigned long long)out.p99, (unsigned long long)out.p999, (unsigned long long)out.max,
+               (unsigned long long)in.p50, (unsigned long long)in.p99, (unsigned long long)in.p999, (unsigned long long)in.max);
+        printf("\"filter\":\"%s\",\"bytes\":{\"generated\":%llu,\"to_coremidi\":%llu,\"to_jack\":%llu},",
+               filter ? filter : "",
+               (unsigned long long)bytesGenerated, (unsigned long long)bytesOut, (unsigned long long)bytesIn);
+        if (ump) {
+            printf("\"ump\":{\"protocol\":%d,\"packets\":%llu,\"events\":%llu,\"ns_per_event\":%.1f,\"errors\":%llu},",
+                   ump, (unsigned long long)umpPackets, (unsigned long long)umpEvents,
+                   umpEvents ? (double)umpNs/umpEvents : 0.0, (unsigned long long)umpErrors);
+        }
+        printf("\"arena_bytes\":%zu,", Arena::global().footprint());
+        printf("\"allocations\":{\"total\":%llu,\"per_cycle\":%.3f,\"per_event\":%.3f}}\n",
+               (unsigned long long)allocs, (double)allocs/cycles, delivered ? (double)allocs/delivered : 0.0);
+    } else {
+        printf("stream: %s, ports: %d, events/cycle: %d, cycles: %d, frames/cycle: %d\n",
+               typeName, nports, eventsPerCycle, cycles, nframes);
+        printf("delivered: %llu / %llu events in %.6f sec (%.0f events/sec)\n",
+               (unsigned long long)delivered, (unsigned long long)(eventsPerDir*2), seconds, rate);
+        printf("latency Jack->CoreMIDI (ns): p50 %llu, p99 %llu, p99.9 %llu, max %llu\n",
+               (unsigned long long)out.p50, (unsigned long long)out.p99, (unsigned long long)out.p999, (unsigned long long)out.max);
+        printf("latency CoreMIDI->Jack (ns): p50 %llu, p99 %llu, p99.9 %llu, max %llu\n",
+               (unsigned long long)in.p50, (unsigned long long)in.p99, (unsigned long long)in.p999, (unsigned long long)in.max);
+        printf("bytes: %llu generated, %llu to CoreMIDI, %llu to Jack (filter: %s)\n",
+               (unsigned long long)bytesGenerated, (unsigned long long)bytesOut, (unsigned long long)bytesIn,
+               filter ? filter : "none");
+        if (ump) {
+            printf("UMP round trip (MIDI %d.0): %llu packets, %llu events, %.1f ns/event, errors: %llu\n",
+                   ump, (unsigned long long)umpPackets, (unsigned long long)umpEvents,
+                   umpEvents ? (double)umpNs/umpEvents : 0.0, (unsigned long long)umpErrors);
+        }
+        Arena::global().report(stdout);
+        printf("allocations: %llu (%.3f/cycle, %.3f/event)\n",
+               (unsigned long long)allocs, (double)allocs/cycles, delivered ? (double)allocs/delivered : 0.0);
+    }
+
+    rtmidi_stub_send_hook = NULL;
+    jack_stub_midi_write_hook = NULL;
+    bridge.release_ports();
+    for (int n=0; n<nports; n++) {
+        free(jackIn[n].buffer);
+        free(jackOut[n].buffer);
+        free(bufUmp[n]);
+    }
+    return umpErrors ? 1 : 0;
+}
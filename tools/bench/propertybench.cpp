@@ -0,0 +1,173 @@
+/*
+ File: propertybench.cpp
+
+ Sample rate getter benchmark for SA_Device
+ (driver/JackBridge/Plug-In/SA_Device.cpp).
+
+ The host polls kAudioDevicePropertyNominalSampleRate and the stream
+ formats. Both getters used to copy the sample rate under the state mutex;
+ they now load the atomic mSampleRateShadow. The two getters are replayed
+ here side by side, the locked one with a pthread mutex like CAMutex.
+
+ With '-t' readers run in that many threads while a configuration change
+ writes a new rate under the mutex every '-r' microseconds, the way
+ PerformConfigChange() does. A rate that isn't one of the device's rates
+ is counted as an error.
+
+ Usage: propertybench [-n lookups/thread] [-t threads] [-r change us] [-j]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock benchClock;
+
+#define SAMPLE_RATES    6
+
+static const uint64_t rates[SAMPLE_RATES] = { 44100, 48000, 88200, 96000, 176400, 192000 };
+
+// the state of SA_Device involved in the getters
+class deviceState {
+public:
+    deviceState() : rateShadow(48000), lockedRate(48000) {
+        pthread_mutex_init(&mutex, NULL);
+    }
+    ~deviceState() {
+        pthread_mutex_destroy(&mutex);
+    }
+
+    double get_locked() {
+        pthread_mutex_lock(&mutex);
+        double r = (double)lockedRate;
+        pthread_mutex_unlock(&mutex);
+        return r;
+    }
+
+    double get_atomic() const {
+        return (double)rateShadow.load(std::memory_order_relaxed);
+    }
+
+    void set(uint64_t rate) {
+        pthread_mutex_lock(&mutex);
+        lockedRate = rate;
+        rateShadow.store(rate, std::memory_order_relaxed);
+        pthread_mutex_unlock(&mutex);
+    }
+
+private:
+    pthread_mutex_t         mutex;
+    std::atomic<uint64_t>   rateShadow;
+    uint64_t                lockedRate;
+};
+
+static bool valid(double rate) {
+    for (int i=0; i<SAMPLE_RATES; i++) {
+        if (rate == (double)rates[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    double      nsLocked;   // per lookup
+    double      nsAtomic;
+    uint64_t    errors;
+} result;
+
+static void reader(deviceState* state, int lookups, bool locked, uint64_t* ns, uint64_t* errors) {
+    uint64_t bad = 0;
+    benchClock::time_point t0 = benchClock::now();
+    for (int i=0; i<lookups; i++) {
+        double r = locked ? state->get_locked() : state->get_atomic();
+        if (!valid(r)) {
+            bad++;
+        }
+    }
+    *ns = std::chrono::duration_cast<std::chrono::nanoseconds>(benchClock::now() - t0).count();
+    *errors = bad;
+}
+
+static double run(deviceState& state, int lookups, int threads, int changeUs, bool locked, uint64_t& errors) {
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+        int n = 0;
+        while (!done.load()) {
+            state.set(rates[n++ % SAMPLE_RATES]);
+            if (changeUs > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(changeUs));
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::vector<std::thread> readers;
+    std::vector<uint64_t> ns(threads), bad(threads);
+    for (int t=0; t<threads; t++) {
+        readers.push_back(std::thread(reader, &state, lookups, locked, &ns[t], &bad[t]));
+    }
+    uint64_t totalNs = 0;
+    for (int t=0; t<threads; t++) {
+        readers[t].join();
+        totalNs += ns[t];
+        errors += bad[t];
+    }
+    done.store(true);
+    writer.join();
+    return (double)totalNs / ((double)lookups * threads);
+}
+
+int
+main(int argc, char** argv)
+{
+    int ch;
+    int lookups = 10000000, threads = 1, changeUs = 1000;
+    bool json = false;
+
+    while ((ch = getopt(argc, argv, "n:t:r:j")) != -1) {
+        switch (ch) {
+            case 'n':
+                lookups = atoi(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'r':
+                changeUs = atoi(optarg);
+                break;
+            case 'j':
+                json = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n lookups/thread] [-t threads] [-r change us] [-j]\n", argv[0]);
+                return -1;
+        }
+    }
+    if ((lookups <= 0) || (threads <= 0) || (changeUs < 0)) {
+        fprintf(stderr, "%s: invalid parameter\n", argv[0]);
+        return -1;
+    }
+
+    deviceState state;
+    result r = { 0.0, 0.0, 0 };
+    r.nsLocked = run(state, lookups, threads, changeUs, true, r.errors);
+    r.nsAtomic = run(state, lookups, threads, changeUs, false, r.errors);
+
+    if (json) {
+        printf("{\"benchmark\":\"propertybench\",\"lookups\":%d,\"threads\":%d,\"change_us\":%d,"
+               "\"ns_locked\":%.2f,\"ns_atomic\":%.2f,\"errors\":%llu}\n",
+               lookups, threads, changeUs, r.nsLocked, r.nsAtomic, (unsigned long long)r.errors);
+    } else {
+        printf("lookups/thread: %d, threads: %d, rate change every %d us\n", lookups, threads, changeUs);
+        printf("state lock: %.2f ns/lookup\n", r.nsLocked);
+        printf("atomic    : %.2f ns/lookup\n", r.nsAtomic);
+        printf("errors: %llu\n", (unsigned long long)r.errors);
+    }
+    return (r.errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+/*
+ File: jack.h (stand-in)
+
+ Minimal in-process stand-in for <jack/jack.h> used by the benchmarks under
+ tools/bench. It only provides what the bridge code needs to run outside of
+ jackd: port objects whose buffers are owned by the benchmark itself.
+ */
+#ifndef __JACK_STUB_JACK_H__
+#define __JACK_STUB_JACK_H__
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t jack_nframes_t;
+typedef float jack_default_audio_sample_t;
+
+#define JACK_DEFAULT_AUDIO_TYPE "32 bit float mono audio"
+#define JACK_DEFAULT_MIDI_TYPE  "8 bit raw midi"
+
+enum JackPortFlags {
+    JackPortIsInput    = 0x1,
+    JackPortIsOutput   = 0x2,
+    JackPortIsPhysical = 0x4,
+    JackPortCanMonitor = 0x8,
+    JackPortIsTerminal = 0x10
+};
+
+typedef enum {
+    JackTransportStopped = 0,
+    JackTransportRolling = 1,
+    JackTransportLooping = 2,
+    JackTransportStarting = 3
+} jack_transport_state_t;
+
+typedef enum {
+    JackPositionBBT = 0x10,
+    JackPositionTimecode = 0x20
+} jack_position_bits_t;
+
+typedef struct {
+    uint64_t             unique_1;
+    uint64_t             usecs;
+    jack_nframes_t       frame_rate;
+    jack_nframes_t       frame;
+    jack_position_bits_t valid;
+    int32_t              bar;
+    int32_t              beat;
+    int32_t              tick;
+    double               bar_start_tick;
+    float                beats_per_bar;
+    float                beat_type;
+    double               ticks_per_beat;
+    double               beats_per_minute;
+} jack_position_t;
+
+typedef struct _jack_port {
+    void* buffer;       // set up by the benchmark
+    int   connections;  // reported by jack_port_connected()
+} jack_port_t;
+
+static inline void* jack_port_get_buffer(jack_port_t* port, jack_nframes_t nframes) {
+    (void)nframes;
+    return port->buffer;
+}
+
+static inline int jack_port_connected(const jack_port_t* port) {
+    return port->connections;
+}
+
+#endif // __JACK_STUB_JACK_H__
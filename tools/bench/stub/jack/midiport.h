@@ -0,0 +1,101 @@
+/*
+ File: midiport.h (stand-in)
+
+ Minimal in-process stand-in for <jack/midiport.h>. A MIDI port buffer is a
+ fixed size jack_stub_midi_buffer_t, so the stand-in itself never allocates
+ while a benchmark is running.
+ */
+#ifndef __JACK_STUB_MIDIPORT_H__
+#define __JACK_STUB_MIDIPORT_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "jack.h"
+
+typedef unsigned char jack_midi_data_t;
+
+typedef struct _jack_midi_event {
+    jack_nframes_t    time;
+    size_t            size;
+    jack_midi_data_t* buffer;
+} jack_midi_event_t;
+
+#define JACK_STUB_MIDI_EVENTS   8192
+#define JACK_STUB_MIDI_BYTES    (1024*1024)
+
+typedef struct {
+    uint32_t          nevents;
+    uint32_t          used;
+    uint32_t          lost;
+    jack_midi_event_t events[JACK_STUB_MIDI_EVENTS];
+    jack_midi_data_t  data[JACK_STUB_MIDI_BYTES];
+} jack_stub_midi_buffer_t;
+
+// Optional hook called whenever an event is written into a port buffer.
+// The benchmarks use it to timestamp delivery.
+typedef void (*jack_stub_midi_hook_t)(void* port_buffer, jack_nframes_t time, size_t size);
+static jack_stub_midi_hook_t jack_stub_midi_write_hook = NULL;
+
+static inline jack_stub_midi_buffer_t* jack_stub_midi_buffer_new() {
+    jack_stub_midi_buffer_t* buf = (jack_stub_midi_buffer_t*)calloc(1, sizeof(jack_stub_midi_buffer_t));
+    return buf;
+}
+
+static inline uint32_t jack_midi_get_event_count(void* port_buffer) {
+    return ((jack_stub_midi_buffer_t*)port_buffer)->nevents;
+}
+
+static inline int jack_midi_event_get(jack_midi_event_t* event, void* port_buffer, uint32_t event_index) {
+    jack_stub_midi_buffer_t* buf = (jack_stub_midi_buffer_t*)port_buffer;
+    if (event_index >= buf->nevents) {
+        return -1;
+    }
+    *event = buf->events[event_index];
+    return 0;
+}
+
+static inline void jack_midi_clear_buffer(void* port_buffer) {
+    jack_stub_midi_buffer_t* buf = (jack_stub_midi_buffer_t*)port_buffer;
+    buf->nevents = 0;
+    buf->used = 0;
+}
+
+static inline size_t jack_midi_max_event_size(void* port_buffer) {
+    jack_stub_midi_buffer_t* buf = (jack_stub_midi_buffer_t*)port_buffer;
+    return JACK_STUB_MIDI_BYTES - buf->used;
+}
+
+static inline jack_midi_data_t* jack_midi_event_reserve(void* port_buffer, jack_nframes_t time, size_t data_size) {
+    jack_stub_midi_buffer_t* buf = (jack_stub_midi_buffer_t*)port_buffer;
+    if ((buf->nevents >= JACK_STUB_MIDI_EVENTS) || (buf->used + data_size > JACK_STUB_MIDI_BYTES)
+        || ((buf->nevents > 0) && (time < buf->events[buf->nevents-1].time))) {
+        buf->lost++;
+        return NULL;
+    }
+    jack_midi_event_t* ev = &buf->events[buf->nevents++];
+    ev->time = time;
+    ev->size = data_size;
+    ev->buffer = buf->data + buf->used;
+    buf->used += data_size;
+    if (jack_stub_midi_write_hook) {
+        jack_stub_midi_write_hook(port_buffer, time, data_size);
+    }
+    return ev->buffer;
+}
+
+static inline int jack_midi_event_write(void* port_buffer, jack_nframes_t time, const jack_midi_data_t* data, size_t data_size) {
+    jack_midi_data_t* dst = jack_midi_event_reserve(port_buffer, time, data_size);
+    if (dst == NULL) {
+        return -1;
+    }
+    for (size_t i=0; i<data_size; i++) {
+        dst[i] = data[i];
+    }
+    return 0;
+}
+
+static inline uint32_t jack_midi_get_lost_event_count(void* port_buffer) {
+    return ((jack_stub_midi_buffer_t*)port_buffer)->lost;
+}
+
+#endif // __JACK_STUB_MIDIPORT_H__
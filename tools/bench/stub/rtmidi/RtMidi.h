@@ -0,0 +1,95 @@
+/*
+ File: RtMidi.h (stand-in)
+
+ Minimal in-process stand-in for the parts of RtMidi used by the daemon.
+ RtMidiOut hands every message to a hook instead of CoreMIDI, RtMidiIn is
+ fed by the benchmark through stub_push() which plays the role of the
+ CoreMIDI receive thread.
+ */
+#ifndef __RTMIDI_STUB_H__
+#define __RTMIDI_STUB_H__
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+
+class RtMidiError {
+public:
+    void printMessage() const { fprintf(stderr, "RtMidiError (stand-in)\n"); }
+};
+
+class RtMidi {
+public:
+    enum Api { UNSPECIFIED, MACOSX_CORE };
+};
+
+class RtMidiOut;
+typedef void (*RtMidiStubSendHook)(RtMidiOut* port, const unsigned char* message, size_t size);
+static RtMidiStubSendHook rtmidi_stub_send_hook = NULL;
+
+class RtMidiOut {
+public:
+    RtMidiOut(RtMidi::Api api = RtMidi::UNSPECIFIED, const std::string& clientName = "") {
+        (void)api; (void)clientName;
+    }
+    void openVirtualPort(const std::string& portName = "") { (void)portName; }
+
+    void sendMessage(const std::vector<unsigned char>* message) {
+        sendMessage(message->data(), message->size());
+    }
+    void sendMessage(const unsigned char* message, size_t size) {
+        if (rtmidi_stub_send_hook) {
+            rtmidi_stub_send_hook(this, message, size);
+        }
+    }
+};
+
+class RtMidiIn {
+public:
+    typedef void (*RtMidiCallback)(double timeStamp, std::vector<unsigned char>* message, void* userData);
+
+    RtMidiIn(RtMidi::Api api = RtMidi::UNSPECIFIED, const std::string& clientName = "", unsigned int queueSizeLimit = 100) {
+        (void)api; (void)clientName; (void)queueSizeLimit;
+        callback = NULL;
+        userData = NULL;
+    }
+    void openVirtualPort(const std::string& portName = "") { (void)portName; }
+    void ignoreTypes(bool midiSysex = true, bool midiTime = true, bool midiSense = true) {
+        (void)midiSysex; (void)midiTime; (void)midiSense;
+    }
+    void setCallback(RtMidiCallback cb, void* data = 0) {
+        callback = cb;
+        userData = data;
+    }
+    void cancelCallback() {
+        callback = NULL;
+        userData = NULL;
+    }
+
+    double getMessage(std::vector<unsigned char>* message) {
+        message->clear();
+        if (queue.empty()) {
+            return 0.0;
+        }
+        *message = queue.front();
+        queue.pop_front();
+        return 0.0;
+    }
+
+    // Stand-in only: deliver a message as if it had arrived from CoreMIDI.
+    void stub_push(const unsigned char* message, size_t size) {
+        std::vector<unsigned char> m(message, message+size);
+        if (callback) {
+            callback(0.0, &m, userData);
+        } else {
+            queue.push_back(m);
+        }
+    }
+
+private:
+    RtMidiCallback callback;
+    void* userData;
+    std::deque< std::vector<unsigned char> > queue;
+};
+
+#endif // __RTMIDI_STUB_H__